@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"  // for BenchRunner
+#include "crypto/sha256.h" // for SHA256AutoDetect
 #include "key.h"    // for ECC_Start, ECC_Stop
 #include "util.h"   // for SetupEnvironment, fPrintToDebugLog
 #include "random.h"
@@ -11,6 +12,7 @@ int
 main(int argc, char** argv)
 {
     RandomInit();
+    SHA256AutoDetect();
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
@@ -6,6 +6,8 @@
 #include "util.h"
 #include "validation.h"
 #include "checkqueue.h"
+#include "crypto/sha256.h"
+#include "uint256.h"
 #include "prevector.h"
 #include <vector>
 #include <boost/thread/thread.hpp>
@@ -99,5 +101,55 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark measures how the CheckQueue scales with the number of
+// worker threads, using checks that each do a small, fixed amount of work
+// so that the queue overhead is visible next to useful work.
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        uint256 h;
+        bool operator()()
+        {
+            for (int i = 0; i < 16; i++)
+                CSHA256().Write(h.begin(), 32).Finalize(h.begin());
+            return true;
+        }
+        void swap(HashJob& x){std::swap(h, x.h);};
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    // The master thread takes part in the verification as well.
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        std::vector<std::vector<HashJob>> vBatches(BATCHES);
+        for (auto& vChecks : vBatches) {
+            vChecks.resize(BATCH_SIZE);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueScaling1(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling2(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling4(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling8(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling16(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling32(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+static void CCheckQueueScaling64(benchmark::State& state) { CCheckQueueScaling(state, 64); }
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueScaling1);
+BENCHMARK(CCheckQueueScaling2);
+BENCHMARK(CCheckQueueScaling4);
+BENCHMARK(CCheckQueueScaling8);
+BENCHMARK(CCheckQueueScaling16);
+BENCHMARK(CCheckQueueScaling32);
+BENCHMARK(CCheckQueueScaling64);
@@ -0,0 +1,200 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "base58.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "miner.h"
+#include "net.h"
+#include "pow.h"
+#include "random.h"
+#include "rpc/register.h"
+#include "rpc/server.h"
+#include "script/sigcache.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "versionbits.h"
+
+#include <univalue.h>
+
+/** Number of transactions in the mempool the templates are built from */
+static const int MEMPOOL_TXS = 2000;
+
+/** Extend the chain with a block holding just a coinbase. */
+static void ConnectEmptyBlock(const CChainParams& chainparams)
+{
+    CBlock block;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindexPrev = chainActive.Tip();
+        const Consensus::Params& consensus = chainparams.GetConsensus(pindexPrev->nHeight + 1);
+        CMutableTransaction coinbaseTx;
+        coinbaseTx.vin.resize(1);
+        coinbaseTx.vin[0].prevout.SetNull();
+        coinbaseTx.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+        coinbaseTx.vout.resize(1);
+        coinbaseTx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        coinbaseTx.vout[0].nValue = 0;
+        block.vtx.push_back(MakeTransactionRef(std::move(coinbaseTx)));
+        block.SetBaseVersion(VERSIONBITS_LAST_OLD_BLOCK_VERSION, consensus.nAuxpowChainId);
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        block.nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
+        block.nBits = GetNextWorkRequired(pindexPrev, &block, consensus);
+        while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensus)) ++block.nNonce;
+    }
+    ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, NULL);
+}
+
+/** Add a transaction spending a fake coin to the mempool. */
+static CTransactionRef AddMempoolTx(CAmount nFee)
+{
+    const CScript scriptTrue = CScript() << OP_TRUE;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = scriptTrue;
+    tx.vout[0].nValue = 10 * COIN - nFee;
+    LOCK(cs_main);
+    pcoinsTip->AddCoin(tx.vin[0].prevout, Coin(CTxOut(10 * COIN, scriptTrue), 1, false), false);
+    mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(MakeTransactionRef(tx), nFee, GetTime(), 0.0, 1,
+                                                       10 * COIN, false, 4, LockPoints()));
+    return MakeTransactionRef(tx);
+}
+
+/**
+ * Set up a regtest chain up to the start of merge mining, in a temporary
+ * datadir, with MEMPOOL_TXS transactions of different fee rates in the
+ * mempool.
+ */
+static fs::path SetUpMiningChain()
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const CChainParams& chainparams = Params();
+    InitSignatureCache();
+    InitScriptExecutionCache();
+    ClearDatadirCache();
+    fs::path pathTemp = fs::temp_directory_path() / strprintf("bench_dogecoin_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    fs::create_directories(pathTemp);
+    ForceSetArg("-datadir", pathTemp.string());
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    InitBlockIndex(chainparams);
+    {
+        CValidationState state;
+        ActivateBestChain(state, chainparams);
+    }
+    RegisterAllCoreRPCCommands(tableRPC);
+    if (RPCIsInWarmup(NULL))
+        SetRPCWarmupFinished();
+    g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337));
+
+    // Mine up to the start of merge mining
+    const CScript scriptTrue = CScript() << OP_TRUE;
+    while (chainparams.GetConsensus(chainActive.Height() + 1).fAllowLegacyBlocks) {
+        std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptTrue, false);
+        CBlock& block = pblocktemplate->block;
+        unsigned int nExtraNonce = 0;
+        IncrementExtraNonce(&block, chainActive.Tip(), nExtraNonce);
+        while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, chainparams.GetConsensus(0))) ++block.nNonce;
+        ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, NULL);
+    }
+
+    for (int i = 0; i < MEMPOOL_TXS; i++)
+        AddMempoolTx(COIN + i * 1000);
+
+    return pathTemp;
+}
+
+static void TearDownMiningChain(const fs::path& pathTemp)
+{
+    SetMockTime(0);
+    g_connman.reset();
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    pcoinsTip = NULL;
+    delete pcoinsdbview;
+    pcoinsdbview = NULL;
+    delete pblocktree;
+    pblocktree = NULL;
+    fs::remove_all(pathTemp);
+}
+
+// Latency of serving createauxblock to a pool with nScripts payout scripts
+// after a new tip: one transaction selection, and a block per script. The
+// time includes connecting the (empty) new tip.
+static void CreateAuxBlock(benchmark::State& state, int nScripts)
+{
+    const fs::path pathTemp = SetUpMiningChain();
+    const CChainParams& chainparams = Params();
+
+    std::vector<std::string> vAddresses;
+    for (int i = 0; i < nScripts; i++) {
+        uint160 hash;
+        GetRandBytes(hash.begin(), hash.size());
+        vAddresses.push_back(CBitcoinAddress(CKeyID(hash)).ToString());
+    }
+
+    JSONRPCRequest request;
+    request.strMethod = "createauxblock";
+    int64_t nTime = GetTime();
+    while (state.KeepRunning()) {
+        SetMockTime(++nTime);
+        ConnectEmptyBlock(chainparams);
+        for (const std::string& address : vAddresses) {
+            request.params = UniValue(UniValue::VARR);
+            request.params.push_back(address);
+            tableRPC.execute(request);
+        }
+    }
+
+    TearDownMiningChain(pathTemp);
+}
+
+// Latency of a block template after a transaction enters the mempool (and
+// another one leaves it), with a full transaction selection or with the
+// template kept up to date by IncrementalBlockAssembler.
+static void BlockTemplateAfterTx(benchmark::State& state, bool fIncremental)
+{
+    const fs::path pathTemp = SetUpMiningChain();
+    const CChainParams& chainparams = Params();
+    const CScript scriptTrue = CScript() << OP_TRUE;
+
+    CTransactionRef tx = AddMempoolTx(2 * COIN);
+    while (state.KeepRunning()) {
+        {
+            LOCK(cs_main);
+            mempool.removeRecursive(*tx);
+        }
+        tx = AddMempoolTx(2 * COIN);
+        if (fIncremental)
+            CreateIncrementalBlock(chainparams, scriptTrue, false);
+        else
+            BlockAssembler(chainparams).CreateNewBlock(scriptTrue, false);
+    }
+
+    TearDownMiningChain(pathTemp);
+}
+
+static void CreateAuxBlock1(benchmark::State& state) { CreateAuxBlock(state, 1); }
+static void CreateAuxBlock10(benchmark::State& state) { CreateAuxBlock(state, 10); }
+static void CreateAuxBlock100(benchmark::State& state) { CreateAuxBlock(state, 100); }
+
+BENCHMARK(CreateAuxBlock1);
+BENCHMARK(CreateAuxBlock10);
+BENCHMARK(CreateAuxBlock100);
+
+static void BlockTemplateFull(benchmark::State& state) { BlockTemplateAfterTx(state, false); }
+static void BlockTemplateIncremental(benchmark::State& state) { BlockTemplateAfterTx(state, true); }
+
+BENCHMARK(BlockTemplateFull);
+BENCHMARK(BlockTemplateIncremental);
@@ -60,6 +60,13 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning())
+        SHA256D64(in.data(), in.data(), 1024);
+}
+
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
@@ -98,6 +105,7 @@ BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
 BENCHMARK(SipHash_32b);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
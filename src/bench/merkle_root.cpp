@@ -0,0 +1,48 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "consensus/merkle.h"
+#include "merkleblock.h"
+#include "random.h"
+#include "uint256.h"
+
+// The merkle root of a 5000 transaction block, as computed by CheckBlock and
+// for compact block reconstruction
+static void MerkleRoot(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> leaves(5000);
+    for (auto& item : leaves) {
+        item = rng.rand256();
+    }
+    while (state.KeepRunning()) {
+        bool mutated = false;
+        uint256 hash = ComputeMerkleRoot(leaves, &mutated);
+        leaves[mutated] = hash;
+    }
+}
+
+// A partial merkle tree for one transaction of a 5000 transaction block, as
+// sent to filtering peers
+static void PartialMerkleTree(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> leaves(5000);
+    for (auto& item : leaves) {
+        item = rng.rand256();
+    }
+    std::vector<bool> vMatch(leaves.size(), false);
+    vMatch[leaves.size() / 2] = true;
+    while (state.KeepRunning()) {
+        CPartialMerkleTree tree(leaves, vMatch);
+        std::vector<uint256> vMatched;
+        std::vector<unsigned int> vIndex;
+        leaves[0] = tree.ExtractMatches(vMatched, vIndex);
+    }
+}
+
+BENCHMARK(MerkleRoot);
+BENCHMARK(PartialMerkleTree);
@@ -25,4 +25,85 @@ static void Scrypt(benchmark::State& state)
     }
 }
 
+// The multi-lane benchmarks below all hash SCRYPT_MAX_LANES distinct headers
+// per iteration, so their timings compare directly with ScryptGenericLanes.
+typedef void (*ScryptLanesKernel)(const char * const *input, char * const *output, char *scratchpad);
+
+static void ScryptLanes(benchmark::State& state, ScryptLanesKernel kernel, int lanes)
+{
+    std::vector<std::vector<char>> in(SCRYPT_MAX_LANES, std::vector<char>(BUFFER_SIZE, 0));
+    std::vector<uint256> out(SCRYPT_MAX_LANES);
+    std::vector<const char*> vInput;
+    std::vector<char*> vOutput;
+    for (int i = 0; i < SCRYPT_MAX_LANES; i++) {
+        in[i][76] = i; // distinct nonces
+        vInput.push_back(in[i].data());
+        vOutput.push_back(BEGIN(out[i]));
+    }
+    std::vector<char> scratchpad(SCRYPT_SCRATCHPAD_SIZE_LANES(lanes));
+
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < SCRYPT_MAX_LANES; i += lanes)
+            kernel(&vInput[i], &vOutput[i], scratchpad.data());
+    }
+}
+
+static void ScryptGenericLanes(benchmark::State& state)
+{
+    ScryptLanes(state, [](const char * const *input, char * const *output, char *scratchpad) {
+        scrypt_1024_1_1_256_sp_generic(input[0], output[0], scratchpad);
+    }, 1);
+}
+
+static void ScryptGeneric4Way(benchmark::State& state)
+{
+    ScryptLanes(state, &scrypt_1024_1_1_256_sp_generic_4way, 4);
+}
+
+#if defined(USE_SCRYPT_NEON)
+static void ScryptNEON4Way(benchmark::State& state)
+{
+    ScryptLanes(state, &scrypt_1024_1_1_256_sp_neon_4way, 4);
+}
+#endif
+
+#if defined(USE_SSE2)
+static void ScryptSSE24Way(benchmark::State& state)
+{
+    ScryptLanes(state, &scrypt_1024_1_1_256_sp_sse2_4way, 4);
+}
+
+#if defined(USE_SCRYPT_AVX2)
+static void ScryptAVX28Way(benchmark::State& state)
+{
+    if (!scrypt_detect_avx2()) {
+        std::cerr << "ScryptAVX28Way: CPU lacks AVX2, skipping" << std::endl;
+        return;
+    }
+    ScryptLanes(state, &scrypt_1024_1_1_256_sp_avx2_8way, 8);
+}
+#endif // USE_SCRYPT_AVX2
+#endif // USE_SSE2
+
+static void ScryptBatch(benchmark::State& state)
+{
+    scrypt_detect_batch();
+    ScryptLanes(state, [](const char * const *input, char * const *output, char *scratchpad) {
+        scrypt_1024_1_1_256_batch(input, output, SCRYPT_MAX_LANES);
+    }, SCRYPT_MAX_LANES);
+}
+
 BENCHMARK(Scrypt);
+BENCHMARK(ScryptGenericLanes);
+BENCHMARK(ScryptGeneric4Way);
+#if defined(USE_SCRYPT_NEON)
+BENCHMARK(ScryptNEON4Way);
+#endif
+#if defined(USE_SSE2)
+BENCHMARK(ScryptSSE24Way);
+#if defined(USE_SCRYPT_AVX2)
+BENCHMARK(ScryptAVX28Way);
+#endif
+#endif
+BENCHMARK(ScryptBatch);
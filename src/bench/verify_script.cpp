@@ -9,7 +9,9 @@
 #endif
 #include "script/script.h"
 #include "script/sign.h"
+#include "script/sigcache.h"
 #include "streams.h"
+#include "validation.h"
 
 // FIXME: Dedup with BuildCreditingTransaction in test/script_tests.cpp.
 static CMutableTransaction BuildCreditingTransaction(const CScript& scriptPubKey)
@@ -99,4 +101,105 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+// Microbenchmark for the legacy signature hashes of all inputs of a large
+// consolidation transaction, which is what makes verifying it quadratic.
+static void SignatureHashLegacy(benchmark::State& state, bool fPrecompute)
+{
+    const unsigned int nInputs = 1000;
+
+    CScript scriptCode = CScript() << OP_DUP << OP_HASH160 << ToByteVector(uint160()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CMutableTransaction txCredit = BuildCreditingTransaction(scriptCode);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), txCredit);
+    txSpend.vin.resize(nInputs);
+    for (unsigned int i = 0; i < nInputs; i++) {
+        txSpend.vin[i].prevout.hash = txCredit.GetHash();
+        txSpend.vin[i].prevout.n = i;
+        // Roughly the size of a signature and compressed public key
+        txSpend.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72) << std::vector<unsigned char>(33);
+        txSpend.vin[i].nSequence = CTxIn::SEQUENCE_FINAL;
+    }
+    const CTransaction tx(txSpend);
+
+    while (state.KeepRunning()) {
+        std::unique_ptr<PrecomputedTransactionData> txdata;
+        if (fPrecompute)
+            txdata.reset(new PrecomputedTransactionData(tx));
+        for (unsigned int i = 0; i < nInputs; i++) {
+            uint256 hash = SignatureHash(scriptCode, tx, i, SIGHASH_ALL, 0, SIGVERSION_BASE, txdata.get());
+            assert(!hash.IsNull());
+        }
+    }
+}
+
+static void SignatureHashLegacy1000Inputs(benchmark::State& state)
+{
+    SignatureHashLegacy(state, false);
+}
+
+static void SignatureHashLegacy1000InputsPrecomputed(benchmark::State& state)
+{
+    SignatureHashLegacy(state, true);
+}
+
+// Microbenchmark for verifying the scripts of a transaction whose inputs are
+// all signed with the same key, as in a pool payout consolidation, with the
+// signatures verified inline or deferred and verified together.
+static void VerifyScriptsSameKey(benchmark::State& state, bool fDeferred)
+{
+    const unsigned int nInputs = 100;
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    InitSignatureCache();
+
+    CKey key;
+    const unsigned char vchKey[32] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    key.Set(vchKey, vchKey + 32, true);
+    CPubKey pubkey = key.GetPubKey();
+
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(pubkey.GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey);
+    txCredit.vout.resize(nInputs, txCredit.vout[0]);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), txCredit);
+    txSpend.vin.resize(nInputs);
+    for (unsigned int i = 0; i < nInputs; i++) {
+        txSpend.vin[i].prevout.hash = txCredit.GetHash();
+        txSpend.vin[i].prevout.n = i;
+        txSpend.vin[i].nSequence = CTxIn::SEQUENCE_FINAL;
+    }
+    for (unsigned int i = 0; i < nInputs; i++) {
+        std::vector<unsigned char> vchSig;
+        key.Sign(SignatureHash(scriptPubKey, txSpend, i, SIGHASH_ALL, 0, SIGVERSION_BASE), vchSig);
+        vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        txSpend.vin[i].scriptSig = CScript() << vchSig << ToByteVector(pubkey);
+    }
+    const CTransaction tx(txSpend);
+    PrecomputedTransactionData txdata(tx);
+
+    while (state.KeepRunning()) {
+        CDeferredSigChecks deferred;
+        for (unsigned int i = 0; i < nInputs; i++) {
+            CScriptCheck check(scriptPubKey, txCredit.vout[i].nValue, tx, i, flags, false, &txdata, fDeferred ? &deferred : NULL);
+            bool success = check();
+            assert(success);
+        }
+        if (fDeferred) {
+            bool success = deferred.Verify();
+            assert(success);
+        }
+    }
+}
+
+static void VerifyScriptsSameKeyInline(benchmark::State& state)
+{
+    VerifyScriptsSameKey(state, false);
+}
+
+static void VerifyScriptsSameKeyDeferred(benchmark::State& state)
+{
+    VerifyScriptsSameKey(state, true);
+}
+
 BENCHMARK(VerifyScriptBench);
+BENCHMARK(SignatureHashLegacy1000Inputs);
+BENCHMARK(SignatureHashLegacy1000InputsPrecomputed);
+BENCHMARK(VerifyScriptsSameKeyInline);
+BENCHMARK(VerifyScriptsSameKeyDeferred);
@@ -0,0 +1,258 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "blockindexfile.h"
+
+#include "crypto/common.h"
+#include "util.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+static const unsigned char BLOCK_INDEX_FILE_MAGIC[8] = {'d', 'o', 'g', 'e', 'b', 'i', 'd', 'x'};
+static const uint32_t BLOCK_INDEX_FILE_VERSION = 1;
+
+/**
+ * Header: magic[8], version (u32), record size (u32), record count (u64),
+ * stamp (u64).
+ * Record: hash[32], parent record (u32, NO_PARENT for none), nHeight,
+ * nStatus, nTx, nFile, nDataPos, nUndoPos, nVersion (all 32 bit),
+ * hashMerkleRoot[32], nTime, nBits, nNonce (32 bit).
+ * All integers are little endian.
+ */
+static const size_t HEADER_SIZE = 32;
+static const size_t RECORD_SIZE = 108;
+static const uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+/** Read-only view of a whole file: memory mapped where available. */
+class CMappedFile
+{
+private:
+    const unsigned char* pdata;
+    size_t nSize;
+#ifdef WIN32
+    std::vector<unsigned char> vData;
+#endif
+
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+public:
+    explicit CMappedFile(const fs::path& path) : pdata(nullptr), nSize(0)
+    {
+#ifdef WIN32
+        FILE* file = fsbridge::fopen(path, "rb");
+        if (file == nullptr)
+            return;
+        unsigned char buf[65536];
+        size_t nRead;
+        while ((nRead = fread(buf, 1, sizeof(buf), file)) > 0)
+            vData.insert(vData.end(), buf, buf + nRead);
+        bool fError = ferror(file);
+        fclose(file);
+        if (fError || vData.empty())
+            return;
+        pdata = vData.data();
+        nSize = vData.size();
+#else
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd == -1)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                posix_madvise(addr, st.st_size, POSIX_MADV_SEQUENTIAL);
+                pdata = static_cast<const unsigned char*>(addr);
+                nSize = st.st_size;
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~CMappedFile()
+    {
+#ifndef WIN32
+        if (pdata != nullptr)
+            munmap(const_cast<unsigned char*>(pdata), nSize);
+#endif
+    }
+
+    const unsigned char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+void SerializeRecord(unsigned char* p, const CBlockIndex* pindex, uint32_t nPrev)
+{
+    memcpy(p, pindex->GetBlockHash().begin(), 32);
+    WriteLE32(p + 32, nPrev);
+    WriteLE32(p + 36, pindex->nHeight);
+    WriteLE32(p + 40, pindex->nStatus);
+    WriteLE32(p + 44, pindex->nTx);
+    WriteLE32(p + 48, pindex->nFile);
+    WriteLE32(p + 52, pindex->nDataPos);
+    WriteLE32(p + 56, pindex->nUndoPos);
+    WriteLE32(p + 60, pindex->nVersion);
+    memcpy(p + 64, pindex->hashMerkleRoot.begin(), 32);
+    WriteLE32(p + 96, pindex->nTime);
+    WriteLE32(p + 100, pindex->nBits);
+    WriteLE32(p + 104, pindex->nNonce);
+}
+
+} // namespace
+
+CBlockIndex* CBlockIndexArena::Allocate(size_t n)
+{
+    Clear();
+    pentries = new CBlockIndex[n];
+    nSize = n;
+    return pentries;
+}
+
+void CBlockIndexArena::Clear()
+{
+    delete[] pentries;
+    pentries = nullptr;
+    nSize = 0;
+}
+
+fs::path GetBlockIndexFilePath()
+{
+    return GetDataDir() / "blocks" / "index.dat";
+}
+
+bool WriteBlockIndexFile(const fs::path& path, const BlockMap& mapBlockIndex, uint64_t nStamp)
+{
+    if (mapBlockIndex.size() >= NO_PARENT)
+        return error("%s: too many entries", __func__);
+
+    // Parents before children, so every parent reference points backwards
+    std::vector<const CBlockIndex*> vIndex;
+    vIndex.reserve(mapBlockIndex.size());
+    for (BlockMap::const_iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it)
+        vIndex.push_back(it->second);
+    std::sort(vIndex.begin(), vIndex.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+
+    std::unordered_map<const CBlockIndex*, uint32_t> mapRecord;
+    mapRecord.reserve(vIndex.size());
+
+    fs::path pathTmp = path;
+    pathTmp += ".new";
+    FILE* file = fsbridge::fopen(pathTmp, "wb");
+    if (file == nullptr)
+        return error("%s: failed to open %s", __func__, pathTmp.string());
+
+    unsigned char header[HEADER_SIZE];
+    memcpy(header, BLOCK_INDEX_FILE_MAGIC, sizeof(BLOCK_INDEX_FILE_MAGIC));
+    WriteLE32(header + 8, BLOCK_INDEX_FILE_VERSION);
+    WriteLE32(header + 12, RECORD_SIZE);
+    WriteLE64(header + 16, vIndex.size());
+    WriteLE64(header + 24, nStamp);
+    bool fOk = fwrite(header, 1, HEADER_SIZE, file) == HEADER_SIZE;
+
+    unsigned char record[RECORD_SIZE];
+    for (uint32_t i = 0; fOk && i < vIndex.size(); i++) {
+        const CBlockIndex* pindex = vIndex[i];
+        uint32_t nPrev = NO_PARENT;
+        if (pindex->pprev != nullptr) {
+            std::unordered_map<const CBlockIndex*, uint32_t>::const_iterator it = mapRecord.find(pindex->pprev);
+            if (it == mapRecord.end()) {
+                fOk = false;
+                break;
+            }
+            nPrev = it->second;
+        }
+        mapRecord.emplace(pindex, i);
+        SerializeRecord(record, pindex, nPrev);
+        fOk = fwrite(record, 1, RECORD_SIZE, file) == RECORD_SIZE;
+    }
+
+    if (fOk) {
+        fOk = fflush(file) == 0;
+        FileCommit(file);
+    }
+    fclose(file);
+    if (!fOk || !RenameOver(pathTmp, path)) {
+        boost::system::error_code ec;
+        fs::remove(pathTmp, ec);
+        return error("%s: failed to write %s", __func__, path.string());
+    }
+    return true;
+}
+
+bool LoadBlockIndexFile(const fs::path& path, uint64_t nStamp, BlockMap& mapBlockIndex, CBlockIndexArena& arena)
+{
+    assert(mapBlockIndex.empty());
+
+    CMappedFile file(path);
+    const unsigned char* p = file.data();
+    if (p == nullptr || file.size() < HEADER_SIZE)
+        return false;
+    if (memcmp(p, BLOCK_INDEX_FILE_MAGIC, sizeof(BLOCK_INDEX_FILE_MAGIC)) != 0 ||
+        ReadLE32(p + 8) != BLOCK_INDEX_FILE_VERSION || ReadLE32(p + 12) != RECORD_SIZE)
+        return error("%s: %s has an unknown format", __func__, path.string());
+    if (ReadLE64(p + 24) != nStamp)
+        return error("%s: %s is out of date", __func__, path.string());
+    const uint64_t nRecords = ReadLE64(p + 16);
+    if (nRecords >= NO_PARENT || file.size() != HEADER_SIZE + nRecords * RECORD_SIZE)
+        return error("%s: %s has the wrong size", __func__, path.string());
+
+    CBlockIndex* pentries = arena.Allocate(nRecords);
+    mapBlockIndex.reserve(nRecords);
+    p += HEADER_SIZE;
+    for (uint32_t i = 0; i < nRecords; i++, p += RECORD_SIZE) {
+        CBlockIndex* pindex = pentries + i;
+        const uint32_t nPrev = ReadLE32(p + 32);
+        if (nPrev != NO_PARENT) {
+            if (nPrev >= i)
+                break;
+            pindex->pprev = pentries + nPrev;
+        }
+        pindex->nHeight = ReadLE32(p + 36);
+        pindex->nStatus = ReadLE32(p + 40);
+        pindex->nTx = ReadLE32(p + 44);
+        pindex->nFile = ReadLE32(p + 48);
+        pindex->nDataPos = ReadLE32(p + 52);
+        pindex->nUndoPos = ReadLE32(p + 56);
+        pindex->nVersion = ReadLE32(p + 60);
+        memcpy(pindex->hashMerkleRoot.begin(), p + 64, 32);
+        pindex->nTime = ReadLE32(p + 96);
+        pindex->nBits = ReadLE32(p + 100);
+        pindex->nNonce = ReadLE32(p + 104);
+        if (pindex->nHeight != (pindex->pprev ? pindex->pprev->nHeight + 1 : 0))
+            break;
+
+        uint256 hash;
+        memcpy(hash.begin(), p, 32);
+        std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(std::make_pair(hash, pindex));
+        if (!ret.second)
+            break;
+        pindex->phashBlock = &ret.first->first;
+    }
+
+    if (mapBlockIndex.size() != nRecords) {
+        mapBlockIndex.clear();
+        arena.Clear();
+        return error("%s: %s is inconsistent", __func__, path.string());
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKINDEXFILE_H
+#define BITCOIN_BLOCKINDEXFILE_H
+
+#include "chain.h"
+#include "fs.h"
+#include "validation.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Contiguous storage for the CBlockIndex entries loaded from a flat block
+ * index file. Entries added later (new headers) are still allocated one by
+ * one, so owners of mapBlockIndex must only delete entries the arena does
+ * not contain.
+ */
+class CBlockIndexArena
+{
+private:
+    CBlockIndex* pentries;
+    size_t nSize;
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    CBlockIndexArena& operator=(const CBlockIndexArena&);
+
+public:
+    CBlockIndexArena() : pentries(nullptr), nSize(0) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    /** Replace the arena's contents with n default constructed entries. */
+    CBlockIndex* Allocate(size_t n);
+    void Clear();
+
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return pentries != nullptr && pindex >= pentries && pindex < pentries + nSize;
+    }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Flat block index file (blocks/index.dat).
+ *
+ * A copy of the block index kept in the block tree database, written as
+ * fixed size records in height order with the parent of each entry stored
+ * as a record number. It can be memory mapped and turned into mapBlockIndex
+ * without a database iteration, a hash computation or a map lookup per
+ * block. The file carries a random stamp which is also stored in the block
+ * tree database, and which the database drops with any write to the block
+ * index; a file whose stamp does not match is stale and is not loaded.
+ */
+fs::path GetBlockIndexFilePath();
+
+/** Write all entries of mapBlockIndex to path, under the given stamp. */
+bool WriteBlockIndexFile(const fs::path& path, const BlockMap& mapBlockIndex, uint64_t nStamp);
+
+/**
+ * Build mapBlockIndex, which must be empty, from the file at path, with the
+ * entries allocated from (and replacing the contents of) arena. Fails if the
+ * file is missing, does not carry nStamp or is inconsistent, in which case
+ * mapBlockIndex is left empty.
+ */
+bool LoadBlockIndexFile(const fs::path& path, uint64_t nStamp, BlockMap& mapBlockIndex, CBlockIndexArena& arena);
+
+#endif // BITCOIN_BLOCKINDEXFILE_H
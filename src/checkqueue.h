@@ -6,6 +6,9 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -25,12 +28,31 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Pushed verifications are spread over per-worker deques. Each worker
+  * drains its own deque from the back and, once that is empty, steals from
+  * the front of the other workers' deques, so workers only contend with
+  * each other when they run out of local work. The shared mutex is only
+  * taken to go to sleep and to wake sleeping threads up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A worker's share of the pending verifications.
+    struct WorkerQueue
+    {
+        //! Protects checks; only held for the duration of a push/pop/steal.
+        boost::mutex mutex;
+        //! Pending verifications. Owners pop from the back, thieves from the front.
+        std::deque<T> checks;
+        //! Number of elements in checks, readable without taking mutex.
+        std::atomic<unsigned int> nSize;
+
+        WorkerQueue() : nSize(0) {}
+    };
+
+    //! Mutex to protect the sleep/wake-up state
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,25 +61,33 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Per-worker queues. Fixed in size so they can be scanned without locking.
+    std::vector<std::unique_ptr<WorkerQueue> > vQueues;
+
+    //! Number of worker threads that have registered a home queue.
+    std::atomic<unsigned int> nWorkers;
+
+    //! Round-robin position of the next Add call.
+    std::atomic<unsigned int> nNextQueue;
+
+    //! The number of elements sitting in the per-worker queues.
+    std::atomic<unsigned int> nQueued;
 
     //! The number of workers (including the master) that are idle.
-    int nIdle;
+    std::atomic<int> nIdle;
 
     //! The total number of workers (including the master).
-    int nTotal;
+    std::atomic<int> nTotal;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The temporary evaluation result. Once false, remaining checks are skipped.
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
     //! Whether we're shutting down.
     bool fQuit;
@@ -65,30 +95,75 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Number of per-worker queues currently in use.
+    unsigned int QueuesUsed() const
+    {
+        return std::max(1U, std::min<unsigned int>(nWorkers, vQueues.size()));
+    }
+
+    /**
+     * Move a batch of checks into vChecks, preferring the queue at nHome and
+     * stealing from the others when it is empty. Returns false if no work
+     * was found.
+     */
+    bool Take(unsigned int nHome, std::vector<T>& vChecks)
+    {
+        const unsigned int nUsed = QueuesUsed();
+        for (unsigned int i = 0; i < nUsed; i++) {
+            WorkerQueue& q = *vQueues[(nHome + i) % nUsed];
+            if (q.nSize == 0)
+                continue;
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            if (q.checks.empty())
+                continue;
+            // Decide how many work units to process now.
+            // * Do not try to do everything at once, but aim for increasingly smaller batches so
+            //   all workers finish approximately simultaneously.
+            // * Try to account for idle jobs which will instantly start helping.
+            // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
+            // * When stealing, leave at least half of the victim's queue to its owner.
+            // * Once a check has failed, the remaining ones are only drained, so take them all.
+            unsigned int nSize = q.checks.size();
+            unsigned int nNow = std::max(1U, std::min(nBatchSize, nQueued / (nTotal + nIdle + 1)));
+            if (i != 0)
+                nNow = std::min(nNow, (nSize + 1) / 2);
+            if (!fAllOk)
+                nNow = nSize;
+            nNow = std::min(nNow, nSize);
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++) {
+                // We want the lock on the mutex to be as short as possible, so swap jobs from the
+                // queue to the local batch vector instead of copying.
+                if (i == 0) {
+                    vChecks[j].swap(q.checks.back());
+                    q.checks.pop_back();
+                } else {
+                    vChecks[j].swap(q.checks.front());
+                    q.checks.pop_front();
+                }
+            }
+            q.nSize -= nNow;
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        // The master steals from everyone, so any starting queue will do. Workers
+        // beyond the number of queues share them.
+        const unsigned int nHome = fMaster ? 0 : nWorkers++ % vQueues.size();
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        nTotal++;
         do {
-            {
+            if (!Take(nHome, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
                 // logically, the do loop starts here
-                while (queue.empty()) {
+                while (nQueued == 0) {
                     if ((fMaster || fQuit) && nTodo == 0) {
                         nTotal--;
                         bool fRet = fAllOk;
@@ -102,27 +177,24 @@ private:
                     cond.wait(lock); // wait
                     nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
-            // execute work
+            // execute work, skipping it entirely if some check already failed
+            bool fOk = fAllOk;
             BOOST_FOREACH (T& check, vChecks)
                 if (fOk)
                     fOk = check();
+            if (!fOk)
+                fAllOk = false;
+            // Destroy the checks before reporting them as done, so the master
+            // does not return while their cleanup is still in progress.
+            const unsigned int nNow = vChecks.size();
             vChecks.clear();
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
@@ -130,8 +202,13 @@ public:
     //! Mutex to ensure only one concurrent CCheckQueueControl
     boost::mutex ControlMutex;
 
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue with room for up to nMaxQueues workers without sharing a deque
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxQueues = 64) : nWorkers(0), nNextQueue(0), nQueued(0), nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn)
+    {
+        vQueues.reserve(std::max(1U, nMaxQueues));
+        for (unsigned int i = 0; i < std::max(1U, nMaxQueues); i++)
+            vQueues.emplace_back(new WorkerQueue());
+    }
 
     //! Worker thread
     void Thread()
@@ -148,15 +225,29 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+        // Account for the checks before they become visible to the workers.
         nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        // Spread the checks over the workers' queues in contiguous chunks.
+        const unsigned int nUsed = QueuesUsed();
+        const unsigned int nChunk = (vChecks.size() + nUsed - 1) / nUsed;
+        typename std::vector<T>::iterator it = vChecks.begin();
+        while (it != vChecks.end()) {
+            const unsigned int nNow = std::min<size_t>(nChunk, vChecks.end() - it);
+            WorkerQueue& q = *vQueues[nNextQueue++ % nUsed];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (unsigned int i = 0; i < nNow; i++, ++it) {
+                q.checks.push_back(T());
+                it->swap(q.checks.back());
+            }
+            q.nSize += nNow;
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -0,0 +1,178 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+namespace {
+
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+
+/** The prime is 2^3072 - MAX_PRIME_DIFF, so 2^3072 is MAX_PRIME_DIFF modulo the prime. */
+const limb_t MAX_PRIME_DIFF = 1103717;
+const limb_t LIMB_MAX = ~(limb_t)0;
+
+Num3072 ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(bytes, sizeof(bytes));
+    return Num3072(bytes);
+}
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; i++) {
+        if (LIMB_SIZE == 64)
+            limbs[i] = ReadLE64(data + i * 8);
+        else
+            limbs[i] = ReadLE32(data + i * 4);
+    }
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; i++) {
+        if (LIMB_SIZE == 64)
+            WriteLE64(out + i * 8, limbs[i]);
+        else
+            WriteLE32(out + i * 4, limbs[i]);
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= LIMB_MAX - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != LIMB_MAX)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the prime is adding MAX_PRIME_DIFF and dropping 2^3072.
+    double_limb_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++) {
+        c += limbs[i];
+        limbs[i] = (limb_t)c;
+        c >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t product[2 * LIMBS];
+    memset(product, 0, sizeof(product));
+    for (int i = 0; i < LIMBS; i++) {
+        double_limb_t c = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            c += (double_limb_t)limbs[i] * a.limbs[j] + product[i + j];
+            product[i + j] = (limb_t)c;
+            c >>= LIMB_SIZE;
+        }
+        product[i + LIMBS] = (limb_t)c;
+    }
+
+    // Fold the high half onto the low half, as high * 2^3072 is high * MAX_PRIME_DIFF.
+    double_limb_t c = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        c += (double_limb_t)product[i + LIMBS] * MAX_PRIME_DIFF + product[i];
+        limbs[i] = (limb_t)c;
+        c >>= LIMB_SIZE;
+    }
+    // Fold what carried past 2^3072 the same way; at most twice, as after a
+    // first wrap-around the number is small.
+    while (c != 0) {
+        c *= MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && c != 0; i++) {
+            c += limbs[i];
+            limbs[i] = (limb_t)c;
+            c >>= LIMB_SIZE;
+        }
+    }
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // By Fermat's little theorem, the inverse is this^(p - 2). Square and
+    // multiply over the bits of p - 2 = 2^3072 - MAX_PRIME_DIFF - 2.
+    Num3072 exponent;
+    exponent.limbs[0] = LIMB_MAX - MAX_PRIME_DIFF - 1;
+    for (int i = 1; i < LIMBS; i++)
+        exponent.limbs[i] = LIMB_MAX;
+
+    Num3072 result;
+    for (int i = LIMBS * LIMB_SIZE - 1; i >= 0; i--) {
+        result.Multiply(result);
+        if ((exponent.limbs[i / LIMB_SIZE] >> (i % LIMB_SIZE)) & 1)
+            result.Multiply(*this);
+    }
+    return result;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+    if (IsOverflow())
+        FullReduce();
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len) : numerator(ToNum3072(data, len))
+{
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    numerator.Divide(denominator);
+    // Keep the object valid, and cheap to finalize again.
+    denominator.SetToOne();
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
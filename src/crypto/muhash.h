@@ -0,0 +1,113 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** An integer modulo the prime 2^3072 - 1103717, not necessarily fully reduced. */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static const int LIMBS = 48;
+    static const int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static const int LIMBS = 96;
+    static const int LIMB_SIZE = 32;
+#endif
+
+    limb_t limbs[LIMBS];
+
+    //! Construct from BYTE_SIZE bytes, little endian
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+    Num3072() { SetToOne(); }
+
+    void SetToOne();
+    //! Multiply by a, modulo the prime.
+    void Multiply(const Num3072& a);
+    //! Multiply by the inverse of a, modulo the prime, and reduce fully.
+    void Divide(const Num3072& a);
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char data[BYTE_SIZE];
+        ToBytes(data);
+        s.write((const char*)data, BYTE_SIZE);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char data[BYTE_SIZE];
+        s.read((char*)data, BYTE_SIZE);
+        *this = Num3072(data);
+    }
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+    Num3072 GetInverse() const;
+};
+
+/**
+ * A hash of a set of byte strings (MuHash3072), which can be updated as
+ * elements are added to and removed from the set, in any order.
+ *
+ * Every element is hashed to a number modulo a 3072-bit prime (keying
+ * ChaCha20 with its SHA256 hash), and the set hash is the product of the
+ * numbers of its elements. Removed elements are multiplied into a separate
+ * denominator, so that only Finalize() needs a (costly) modular inversion.
+ * The result is the SHA256 hash of the product.
+ *
+ * Hashes of sets can be combined: (A *= B) hashes the union of A and B, and
+ * (A /= B) the set A with the elements of B removed.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    //! The hash of the empty set
+    MuHash3072() {}
+    //! The hash of the set with one element
+    MuHash3072(const unsigned char* data, size_t len);
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+    MuHash3072& operator*=(const MuHash3072& mul);
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        numerator.Serialize(s);
+        denominator.Serialize(s);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        numerator.Unserialize(s);
+        denominator.Unserialize(s);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
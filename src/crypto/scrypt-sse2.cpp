@@ -34,6 +34,10 @@
 #include <string.h>
 
 #include <emmintrin.h>
+#if defined(USE_SCRYPT_AVX2)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 // this entire functionality is experimental
 EXPERIMENTAL_FEATURE
@@ -137,3 +141,153 @@ void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchp
 
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
+
+/* Multi-lane kernels: vector register k holds word k of every lane. Lanes
+ * only diverge in the data-dependent scratchpad reads, which are gathered
+ * one 32-bit word per lane. */
+static inline void xor_salsa8_sse2_4way(__m128i B[16], const __m128i Bx[16])
+{
+	__m128i x[16];
+	__m128i T;
+	int i, k;
+
+	for (k = 0; k < 16; k++)
+		x[k] = B[k] = _mm_xor_si128(B[k], Bx[k]);
+	for (i = 0; i < 8; i += 2) {
+#define SALSA8_STEP_SSE2(a, b, c, r) \
+		T = _mm_add_epi32(x[b], x[c]); \
+		x[a] = _mm_xor_si128(x[a], _mm_or_si128(_mm_slli_epi32(T, r), _mm_srli_epi32(T, 32 - (r))));
+		SALSA8_DOUBLEROUND(SALSA8_STEP_SSE2)
+#undef SALSA8_STEP_SSE2
+	}
+	for (k = 0; k < 16; k++)
+		B[k] = _mm_add_epi32(B[k], x[k]);
+}
+
+void scrypt_1024_1_1_256_sp_sse2_4way(const char * const *input, char * const *output, char *scratchpad)
+{
+	uint8_t B[128];
+	union {
+		__m128i i128[32];
+		uint32_t u32[32][4];
+	} X;
+	__m128i *V;
+	const uint32_t *V32;
+	uint32_t i, j[4], k, l;
+
+	V = (__m128i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	V32 = (const uint32_t *)V;
+
+	for (l = 0; l < 4; l++) {
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, (const uint8_t *)input[l], 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k][l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = X.i128[k];
+		xor_salsa8_sse2_4way(&X.i128[0], &X.i128[16]);
+		xor_salsa8_sse2_4way(&X.i128[16], &X.i128[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		for (l = 0; l < 4; l++)
+			j[l] = 32 * (X.u32[16][l] & 1023);
+		for (k = 0; k < 32; k++)
+			X.i128[k] = _mm_xor_si128(X.i128[k], _mm_set_epi32(
+				V32[(j[3] + k) * 4 + 3], V32[(j[2] + k) * 4 + 2],
+				V32[(j[1] + k) * 4 + 1], V32[(j[0] + k) * 4 + 0]));
+		xor_salsa8_sse2_4way(&X.i128[0], &X.i128[16]);
+		xor_salsa8_sse2_4way(&X.i128[16], &X.i128[0]);
+	}
+
+	for (l = 0; l < 4; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X.u32[k][l]);
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, B, 128, 1, (uint8_t *)output[l], 32);
+	}
+}
+
+#if defined(USE_SCRYPT_AVX2)
+bool scrypt_detect_avx2()
+{
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int xcr0_lo, xcr0_hi;
+
+	// AVX2 needs the CPU flag and the OS saving ymm state (OSXSAVE + XCR0 bits 1, 2)
+	if (__get_cpuid_max(0, NULL) < 7)
+		return false;
+	__cpuid(1, eax, ebx, ecx, edx);
+	if (!(ecx & (1 << 27)) || !(ecx & (1 << 28)))
+		return false;
+	__asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	if ((xcr0_lo & 6) != 6)
+		return false;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 5)) != 0;
+}
+
+__attribute__((target("avx2")))
+static inline void xor_salsa8_avx2_8way(__m256i B[16], const __m256i Bx[16])
+{
+	__m256i x[16];
+	__m256i T;
+	int i, k;
+
+	for (k = 0; k < 16; k++)
+		x[k] = B[k] = _mm256_xor_si256(B[k], Bx[k]);
+	for (i = 0; i < 8; i += 2) {
+#define SALSA8_STEP_AVX2(a, b, c, r) \
+		T = _mm256_add_epi32(x[b], x[c]); \
+		x[a] = _mm256_xor_si256(x[a], _mm256_or_si256(_mm256_slli_epi32(T, r), _mm256_srli_epi32(T, 32 - (r))));
+		SALSA8_DOUBLEROUND(SALSA8_STEP_AVX2)
+#undef SALSA8_STEP_AVX2
+	}
+	for (k = 0; k < 16; k++)
+		B[k] = _mm256_add_epi32(B[k], x[k]);
+}
+
+__attribute__((target("avx2")))
+void scrypt_1024_1_1_256_sp_avx2_8way(const char * const *input, char * const *output, char *scratchpad)
+{
+	uint8_t B[128];
+	union {
+		__m256i i256[32];
+		uint32_t u32[32][8];
+	} X;
+	__m256i *V;
+	uint32_t i, j[8], k, l;
+
+	V = (__m256i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (l = 0; l < 8; l++) {
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, (const uint8_t *)input[l], 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X.u32[k][l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = X.i256[k];
+		xor_salsa8_avx2_8way(&X.i256[0], &X.i256[16]);
+		xor_salsa8_avx2_8way(&X.i256[16], &X.i256[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		// Word k of lane l in scratchpad row j sits at 32-bit index (j * 32 + k) * 8 + l
+		for (l = 0; l < 8; l++)
+			j[l] = (X.u32[16][l] & 1023) * 256 + l;
+		const __m256i vindex = _mm256_loadu_si256((const __m256i *)j);
+		for (k = 0; k < 32; k++)
+			X.i256[k] = _mm256_xor_si256(X.i256[k],
+				_mm256_i32gather_epi32((const int *)(V + k), vindex, 4));
+		xor_salsa8_avx2_8way(&X.i256[0], &X.i256[16]);
+		xor_salsa8_avx2_8way(&X.i256[16], &X.i256[0]);
+	}
+
+	for (l = 0; l < 8; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X.u32[k][l]);
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, B, 128, 1, (uint8_t *)output[l], 32);
+	}
+}
+#endif // USE_SCRYPT_AVX2
@@ -32,6 +32,11 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <vector>
+
+#if defined(USE_SCRYPT_NEON)
+#include <arm_neon.h>
+#endif
 
 #if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
 #ifdef _MSC_VER
@@ -217,6 +222,137 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
+/* Word k of lane l lives at [k][l], so every inner lane loop is a straight
+ * vector operation the compiler can map onto SSE2, AVX2 or NEON registers. */
+static inline void xor_salsa8_4way(uint32_t B[16][4], const uint32_t Bx[16][4])
+{
+	uint32_t x[16][4];
+	int i, k, l;
+
+	for (k = 0; k < 16; k++)
+		for (l = 0; l < 4; l++)
+			x[k][l] = (B[k][l] ^= Bx[k][l]);
+	for (i = 0; i < 8; i += 2) {
+#define SALSA8_STEP_4WAY(a, b, c, r) \
+		for (l = 0; l < 4; l++) \
+			x[a][l] ^= ROTL(x[b][l] + x[c][l], r);
+		SALSA8_DOUBLEROUND(SALSA8_STEP_4WAY)
+#undef SALSA8_STEP_4WAY
+	}
+	for (k = 0; k < 16; k++)
+		for (l = 0; l < 4; l++)
+			B[k][l] += x[k][l];
+}
+
+void scrypt_1024_1_1_256_sp_generic_4way(const char * const *input, char * const *output, char *scratchpad)
+{
+	uint8_t B[128];
+	uint32_t X[32][4];
+	uint32_t (*V)[32][4];
+	uint32_t i, j, k, l;
+
+	V = (uint32_t (*)[32][4])(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (l = 0; l < 4; l++) {
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, (const uint8_t *)input[l], 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X[k][l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		memcpy(V[i], X, sizeof(X));
+		xor_salsa8_4way(&X[0], &X[16]);
+		xor_salsa8_4way(&X[16], &X[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		for (l = 0; l < 4; l++) {
+			j = X[16][l] & 1023;
+			for (k = 0; k < 32; k++)
+				X[k][l] ^= V[j][k][l];
+		}
+		xor_salsa8_4way(&X[0], &X[16]);
+		xor_salsa8_4way(&X[16], &X[0]);
+	}
+
+	for (l = 0; l < 4; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X[k][l]);
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, B, 128, 1, (uint8_t *)output[l], 32);
+	}
+}
+
+#if defined(USE_SCRYPT_NEON)
+static inline void xor_salsa8_neon_4way(uint32x4_t B[16], const uint32x4_t Bx[16])
+{
+	uint32x4_t x[16];
+	uint32x4_t T;
+	int i, k;
+
+	for (k = 0; k < 16; k++)
+		x[k] = B[k] = veorq_u32(B[k], Bx[k]);
+	for (i = 0; i < 8; i += 2) {
+#define SALSA8_STEP_NEON(a, b, c, r) \
+		T = vaddq_u32(x[b], x[c]); \
+		x[a] = veorq_u32(x[a], vsriq_n_u32(vshlq_n_u32(T, r), T, 32 - (r)));
+		SALSA8_DOUBLEROUND(SALSA8_STEP_NEON)
+#undef SALSA8_STEP_NEON
+	}
+	for (k = 0; k < 16; k++)
+		B[k] = vaddq_u32(B[k], x[k]);
+}
+
+void scrypt_1024_1_1_256_sp_neon_4way(const char * const *input, char * const *output, char *scratchpad)
+{
+	uint8_t B[128];
+	uint32_t W[4];
+	uint32x4_t X[32];
+	uint32x4_t *V;
+	const uint32_t *V32;
+	uint32_t i, j[4], k, l;
+
+	V = (uint32x4_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	V32 = (const uint32_t *)V;
+
+	for (k = 0; k < 32; k++)
+		X[k] = vdupq_n_u32(0);
+	for (l = 0; l < 4; l++) {
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, (const uint8_t *)input[l], 80, 1, B, 128);
+		for (k = 0; k < 32; k++) {
+			vst1q_u32(W, X[k]);
+			W[l] = le32dec(&B[4 * k]);
+			X[k] = vld1q_u32(W);
+		}
+	}
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = X[k];
+		xor_salsa8_neon_4way(&X[0], &X[16]);
+		xor_salsa8_neon_4way(&X[16], &X[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		vst1q_u32(j, X[16]);
+		for (l = 0; l < 4; l++)
+			j[l] = 32 * (j[l] & 1023);
+		for (k = 0; k < 32; k++) {
+			for (l = 0; l < 4; l++)
+				W[l] = V32[(j[l] + k) * 4 + l];
+			X[k] = veorq_u32(X[k], vld1q_u32(W));
+		}
+		xor_salsa8_neon_4way(&X[0], &X[16]);
+		xor_salsa8_neon_4way(&X[16], &X[0]);
+	}
+
+	for (l = 0; l < 4; l++) {
+		for (k = 0; k < 32; k++) {
+			vst1q_u32(W, X[k]);
+			le32enc(&B[4 * k], W[l]);
+		}
+		PBKDF2_SHA256((const uint8_t *)input[l], 80, B, 128, 1, (uint8_t *)output[l], 32);
+	}
+}
+#endif
+
 #if defined(USE_SSE2)
 // By default, set to generic scrypt function. This will prevent crash in case when scrypt_detect_sse2() wasn't called
 void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
@@ -262,3 +398,71 @@ void scrypt_1024_1_1_256(const char *input, char *output)
     memset(scratchpad, 0, sizeof(scratchpad));
     scrypt_1024_1_1_256_sp(input, output, scratchpad);
 }
+
+#if defined(USE_SCRYPT_NEON)
+static void (*scrypt_1024_1_1_256_sp_batch)(const char * const *input, char * const *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_neon_4way;
+#else
+static void (*scrypt_1024_1_1_256_sp_batch)(const char * const *input, char * const *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic_4way;
+#endif
+static int scrypt_batch_lanes_selected = 4;
+
+const char *scrypt_detect_batch()
+{
+#if defined(USE_SSE2)
+#if defined(USE_SCRYPT_AVX2)
+    if (scrypt_detect_avx2()) {
+        scrypt_1024_1_1_256_sp_batch = &scrypt_1024_1_1_256_sp_avx2_8way;
+        scrypt_batch_lanes_selected = 8;
+        return "AVX2 8-way";
+    }
+#endif // USE_SCRYPT_AVX2
+    if (scrypt_detect_sse2()) {
+        scrypt_1024_1_1_256_sp_batch = &scrypt_1024_1_1_256_sp_sse2_4way;
+        scrypt_batch_lanes_selected = 4;
+        return "SSE2 4-way";
+    }
+#endif // USE_SSE2
+    scrypt_batch_lanes_selected = 4;
+#if defined(USE_SCRYPT_NEON)
+    scrypt_1024_1_1_256_sp_batch = &scrypt_1024_1_1_256_sp_neon_4way;
+    return "NEON 4-way";
+#else
+    scrypt_1024_1_1_256_sp_batch = &scrypt_1024_1_1_256_sp_generic_4way;
+    return "generic 4-way";
+#endif
+}
+
+int scrypt_batch_lanes()
+{
+    return scrypt_batch_lanes_selected;
+}
+
+void scrypt_1024_1_1_256_batch(const char * const *input, char * const *output, size_t n)
+{
+    const size_t lanes = scrypt_batch_lanes_selected;
+    thread_local std::vector<char> scratchpad;
+    const char *laneInput[SCRYPT_MAX_LANES];
+    char *laneOutput[SCRYPT_MAX_LANES];
+    char discard[SCRYPT_MAX_LANES][32];
+    size_t i, l;
+
+    scratchpad.resize(SCRYPT_SCRATCHPAD_SIZE_LANES(lanes));
+    for (i = 0; i < n; i += lanes) {
+        // A lone trailing input is cheaper on the single-lane path
+        if (n - i == 1) {
+            scrypt_1024_1_1_256_sp(input[i], output[i], scratchpad.data());
+            break;
+        }
+        // Pad a short final group by repeating its last input into discarded lanes
+        for (l = 0; l < lanes; l++) {
+            if (i + l < n) {
+                laneInput[l] = input[i + l];
+                laneOutput[l] = output[i + l];
+            } else {
+                laneInput[l] = input[n - 1];
+                laneOutput[l] = discard[l];
+            }
+        }
+        scrypt_1024_1_1_256_sp_batch(laneInput, laneOutput, scratchpad.data());
+    }
+}
@@ -14,9 +14,38 @@
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
+/** Widest lane count of any multi-lane scrypt kernel */
+static const int SCRYPT_MAX_LANES = 8;
+/** Scratchpad size needed by a multi-lane kernel hashing `lanes` inputs at once */
+#define SCRYPT_SCRATCHPAD_SIZE_LANES(lanes) (131072 * (lanes) + 63)
+
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+/**
+ * Hash n 80-byte inputs, interleaving them through the widest multi-lane
+ * kernel selected by scrypt_detect_batch(). outputs[i] receives the 32 byte
+ * hash of inputs[i].
+ */
+void scrypt_1024_1_1_256_batch(const char * const *input, char * const *output, size_t n);
+
+/**
+ * Multi-lane kernels: each hashes a fixed number of inputs at once with the
+ * Salsa20/8 state of every lane interleaved word by word, so one vector
+ * instruction advances all lanes. The scratchpad must hold
+ * SCRYPT_SCRATCHPAD_SIZE_LANES(lanes) bytes.
+ */
+void scrypt_1024_1_1_256_sp_generic_4way(const char * const *input, char * const *output, char *scratchpad);
+#if defined(__ARM_NEON)
+#define USE_SCRYPT_NEON 1
+void scrypt_1024_1_1_256_sp_neon_4way(const char * const *input, char * const *output, char *scratchpad);
+#endif
+
+/** Select the multi-lane kernel used by scrypt_1024_1_1_256_batch() for this CPU and return its name */
+const char *scrypt_detect_batch();
+/** Number of inputs hashed together by the selected multi-lane kernel */
+int scrypt_batch_lanes();
+
 #if defined(USE_SSE2)
 #if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
 #define USE_SSE2_ALWAYS 1
@@ -28,6 +57,13 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 bool scrypt_detect_sse2();
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
 extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
+
+void scrypt_1024_1_1_256_sp_sse2_4way(const char * const *input, char * const *output, char *scratchpad);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define USE_SCRYPT_AVX2 1
+bool scrypt_detect_avx2();
+void scrypt_1024_1_1_256_sp_avx2_8way(const char * const *input, char * const *output, char *scratchpad);
+#endif
 #else
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
 #endif
@@ -53,4 +89,16 @@ static inline void le32enc(void *pp, uint32_t x)
         p[3] = (x >> 24) & 0xff;
 }
 #endif
+
+/* Salsa20/8 double rounds as (target, addend, addend, rotation) steps, shared by the multi-lane kernels. */
+#define SALSA8_DOUBLEROUND(STEP) \
+	STEP( 4,  0, 12,  7) STEP( 9,  5,  1,  7) STEP(14, 10,  6,  7) STEP( 3, 15, 11,  7) \
+	STEP( 8,  4,  0,  9) STEP(13,  9,  5,  9) STEP( 2, 14, 10,  9) STEP( 7,  3, 15,  9) \
+	STEP(12,  8,  4, 13) STEP( 1, 13,  9, 13) STEP( 6,  2, 14, 13) STEP(11,  7,  3, 13) \
+	STEP( 0, 12,  8, 18) STEP( 5,  1, 13, 18) STEP(10,  6,  2, 18) STEP(15, 11,  7, 18) \
+	STEP( 1,  0,  3,  7) STEP( 6,  5,  4,  7) STEP(11, 10,  9,  7) STEP(12, 15, 14,  7) \
+	STEP( 2,  1,  0,  9) STEP( 7,  6,  5,  9) STEP( 8, 11, 10,  9) STEP(13, 12, 15,  9) \
+	STEP( 3,  2,  1, 13) STEP( 4,  7,  6, 13) STEP( 9,  8, 11, 13) STEP(14, 13, 12, 13) \
+	STEP( 0,  3,  2, 18) STEP( 5,  4,  7, 18) STEP(10,  9,  8, 18) STEP(15, 14, 13, 18)
+
 #endif // BITCOIN_CRYPTO_SCRYPT_H
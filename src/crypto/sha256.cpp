@@ -31,6 +31,27 @@
 # endif
 #endif  /** ARM Headers */
 
+#if defined(USE_SHA256_MULTIWAY)
+#include <cpuid.h>
+
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(USE_SHA256_SHANI)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
 static const uint32_t K[] =
 {
     0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
@@ -57,7 +78,6 @@ namespace
 /// Internal SHA-256 implementation.
 namespace sha256
 {
-#ifndef USE_AVX2
 uint32_t inline Ch(uint32_t x, uint32_t y, uint32_t z) { return z ^ (x & (y ^ z)); }
 uint32_t inline Maj(uint32_t x, uint32_t y, uint32_t z) { return (x & y) | (z & (x | y)); }
 uint32_t inline Sigma0(uint32_t x) { return (x >> 2 | x << 30) ^ (x >> 13 | x << 19) ^ (x >> 22 | x << 10); }
@@ -73,7 +93,6 @@ void inline Round(uint32_t a, uint32_t b, uint32_t c, uint32_t& d, uint32_t e, u
     d += t1;
     h = t1 + t2;
 }
-#endif
 
 /** Initialize SHA-256 state. */
 void inline Initialize(uint32_t* s)
@@ -88,10 +107,10 @@ void inline Initialize(uint32_t* s)
     s[7] = 0x5be0cd19ul;
 }
 
-/** Perform one SHA-256 transformation, processing a 64-byte chunk. */
-void Transform(uint32_t* s, const unsigned char* chunk)
-{
 #if defined(USE_ARMV8) || defined(USE_ARMV82)
+/** Perform one SHA-256 transformation, processing a 64-byte chunk (ARMv8 crypto extensions). */
+void TransformARMv8(uint32_t* s, const unsigned char* chunk)
+{
     // entire block is experimental
     EXPERIMENTAL_FEATURE
 
@@ -248,13 +267,32 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     /** Save state */
     vst1q_u32(&s[0], STATE0);
     vst1q_u32(&s[4], STATE1);
+}
 
-#elif USE_AVX2
-    // Perform SHA256 one block (Intel AVX2)
+void TransformARMv8(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        TransformARMv8(s, chunk);
+        chunk += 64;
+    }
+}
+#endif
+
+#if defined(USE_AVX2)
+/** Perform SHA-256 transformations, processing 64-byte chunks (Intel AVX2, from intel-ipsec-mb). */
+void TransformAVX2(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
     EXPERIMENTAL_FEATURE
-    sha256_one_block_avx2(chunk, s);
-#else
-    // Perform SHA256 one block (legacy)
+    while (blocks--) {
+        sha256_one_block_avx2(chunk, s);
+        chunk += 64;
+    }
+}
+#endif
+
+/** Perform one SHA-256 transformation, processing a 64-byte chunk. */
+void TransformGeneric(uint32_t* s, const unsigned char* chunk)
+{
     uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
     uint32_t w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
 
@@ -334,10 +372,102 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[5] += f;
     s[6] += g;
     s[7] += h;
+}
+
+/** Perform SHA-256 transformations, processing 64-byte chunks. */
+void TransformGeneric(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        TransformGeneric(s, chunk);
+        chunk += 64;
+    }
+}
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+
+// The transform used, chosen by SHA256AutoDetect. The ARMv8 one is only
+// built when configured for it, and then always used.
+#if defined(USE_ARMV8) || defined(USE_ARMV82)
+TransformType Transform = TransformARMv8;
+#else
+TransformType Transform = TransformGeneric;
 #endif
+
+/** Double-SHA256 of a 64-byte input. */
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    // The padded second block of the input, and the padding of its hash, are constant.
+    static const unsigned char padding64[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    static const unsigned char padding32[32] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    uint32_t s[8];
+    unsigned char buf[64];
+    Initialize(s);
+    Transform(s, in, 1);
+    Transform(s, padding64, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buf + 4 * i, s[i]);
+    memcpy(buf + 32, padding32, sizeof(padding32));
+    Initialize(s);
+    Transform(s, buf, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
 }
 
 } // namespace sha256
+
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+// Multi-way kernels, if the CPU supports them (see SHA256AutoDetect)
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
+#if defined(USE_SHA256_SHANI)
+bool HaveSHANI()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 29)) != 0;
+}
+#endif
+
+#if defined(USE_SHA256_MULTIWAY)
+bool HaveSSE41()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ecx & (1 << 19)) != 0;
+}
+
+bool HaveAVX2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int xcr0_lo, xcr0_hi;
+
+    // AVX2 needs the CPU flag and the OS saving ymm state (OSXSAVE + XCR0 bits 1, 2)
+    if (__get_cpuid_max(0, NULL) < 7)
+        return false;
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (!(ecx & (1 << 27)) || !(ecx & (1 << 28)))
+        return false;
+    __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 5)) != 0;
+}
+#endif
+
 } // namespace
 
 
@@ -357,14 +487,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        sha256::Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        size_t blocks = (end - data) / 64;
+        sha256::Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -397,3 +528,73 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+std::string SHA256AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ARMV8) || defined(USE_ARMV82)
+    ret = "armv8";
+#endif
+#if defined(USE_SHA256_MULTIWAY)
+    const bool fHaveSSE41 = HaveSSE41();
+    const bool fHaveAVX2 = HaveAVX2();
+    bool fHaveSHANI = false;
+#if defined(USE_SHA256_SHANI)
+    // The SHA-NI transform also uses SSE4.1 instructions
+    fHaveSHANI = fHaveSSE41 && HaveSHANI();
+#endif
+
+    if (fHaveSHANI) {
+        sha256::Transform = sha256_shani::Transform;
+        ret = "sha-ni";
+#if defined(USE_AVX2)
+    } else if (fHaveAVX2) {
+        sha256::Transform = sha256::TransformAVX2;
+        ret = "avx2";
+#endif
+    } else {
+        sha256::Transform = sha256::TransformGeneric;
+    }
+
+    // With the SHA extensions, hashing one input at a time is as fast as the
+    // multi-way kernels.
+    TransformD64_4way = nullptr;
+    TransformD64_8way = nullptr;
+    if (fHaveSSE41 && !fHaveSHANI) {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret += " (sse4.1 4-way";
+        if (fHaveAVX2) {
+            TransformD64_8way = sha256d64_avx2::Transform_8way;
+            ret += ", avx2 8-way";
+        }
+        ret += ")";
+    }
+#endif
+    return ret;
+}
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        sha256::TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -8,6 +8,14 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/** Build the multi-way SSE4.1 and AVX2 kernels of SHA256D64, used if the CPU supports them. */
+#define USE_SHA256_MULTIWAY 1
+/** Build the SHA256 transform using the Intel SHA extensions, used if the CPU supports them. */
+#define USE_SHA256_SHANI 1
+#endif
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -26,4 +34,18 @@ public:
     CSHA256& Reset();
 };
 
+/**
+ * Select the fastest SHA256 transform and SHA256D64 kernels this CPU
+ * supports, and return their description. Until it is called, the generic
+ * implementations (or the ARMv8 one, if configured) are used.
+ */
+std::string SHA256AutoDetect();
+
+/**
+ * Compute the double-SHA256 of each of blocks 64-byte inputs, such as the
+ * pairs of hashes hashed together in merkle trees. output (blocks * 32 bytes)
+ * may be the same buffer as input (blocks * 64 bytes).
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -84,7 +84,14 @@ unsigned int CalculateDogecoinNextWorkRequired(const CBlockIndex* pindexLast, in
     return bnNew.GetCompact();
 }
 
-bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params)
+const CPureBlockHeader& GetPoWHeader(const CBlockHeader& block)
+{
+    if (block.auxpow)
+        return block.auxpow->getParentBlock();
+    return block;
+}
+
+bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params, const uint256* pPoWHash)
 {
     /* Except for legacy blocks with full version 1, ensure that
        the chain ID is correct.  Legacy blocks are not allowed since
@@ -102,7 +109,7 @@ bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params&
             return error("%s : no auxpow on block with auxpow version",
                          __func__);
 
-        if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params))
+        if (!CheckProofOfWork(pPoWHash ? *pPoWHash : block.GetPoWHash(), block.nBits, params))
             return error("%s : non-AUX proof of work failed", __func__);
 
         return true;
@@ -113,7 +120,7 @@ bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params&
     if (!block.IsAuxpow())
         return error("%s : auxpow on block with non-auxpow version", __func__);
 
-    if (!CheckProofOfWork(block.auxpow->getParentBlockPoWHash(), block.nBits, params))
+    if (!CheckProofOfWork(pPoWHash ? *pPoWHash : block.auxpow->getParentBlockPoWHash(), block.nBits, params))
         return error("%s : AUX proof of work failed", __func__);
 
     if (!block.auxpow->check(block.GetHash(), block.GetChainId(), params))
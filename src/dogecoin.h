@@ -14,8 +14,16 @@ unsigned int CalculateDogecoinNextWorkRequired(const CBlockIndex* pindexLast, in
  * Check proof-of-work of a block header, taking auxpow into account.
  * @param block The block header.
  * @param params Consensus parameters.
+ * @param pPoWHash If not NULL, the already computed scrypt hash of the header
+ *                 carrying the work (the auxpow parent block if present).
  * @return True iff the PoW is correct.
  */
-bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params);
+bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params, const uint256* pPoWHash = NULL);
+
+/**
+ * Return the header whose scrypt hash must meet the target of a block: the
+ * auxpow parent block for merge-mined blocks, the block itself otherwise.
+ */
+const CPureBlockHeader& GetPoWHeader(const CBlockHeader& block);
 
 
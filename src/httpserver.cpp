@@ -612,6 +612,15 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+std::unique_ptr<HTTPRequest> HTTPRequest::Detach()
+{
+    assert(!replySent && req);
+    std::unique_ptr<HTTPRequest> detached(new HTTPRequest(req));
+    replySent = true;
+    req = 0;
+    return detached;
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
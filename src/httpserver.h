@@ -8,6 +8,7 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -110,6 +111,14 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Take over the request, to reply to it later from any thread.
+     *
+     * @note The returned object must be replied to; this one must not be
+     * used any more, and no longer sends an error reply when destroyed.
+     */
+    std::unique_ptr<HTTPRequest> Detach();
 };
 
 /** Event handler closure.
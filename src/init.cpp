@@ -17,7 +17,8 @@
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
-#include "crypto/scrypt.h" // for scrypt_detect_sse2
+#include "crypto/scrypt.h" // for scrypt_detect_sse2, scrypt_detect_batch
+#include "crypto/sha256.h" // for SHA256AutoDetect
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
@@ -33,6 +34,7 @@
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "templatebroadcast.h"
 #include "timedata.h"
 #include "txdb.h"
 #include "txmempool.h"
@@ -152,9 +154,9 @@ class CCoinsViewErrorCatcher : public CCoinsViewBacked
 {
 public:
     CCoinsViewErrorCatcher(CCoinsView* view) : CCoinsViewBacked(view) {}
-    bool GetCoins(const uint256 &txid, CCoins &coins) const {
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const {
         try {
-            return CCoinsViewBacked::GetCoins(txid, coins);
+            return CCoinsViewBacked::GetCoin(outpoint, coin);
         } catch(const std::runtime_error& e) {
             uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
             LogPrintf("Error reading from database: %s\n", e.what());
@@ -168,12 +170,14 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
 void Interrupt(boost::thread_group& threadGroup)
 {
+    // Answer parked REST requests while the HTTP event loop still runs
+    if (g_templatebroadcaster)
+        g_templatebroadcaster->Interrupt();
     InterruptHTTPServer();
     InterruptHTTPRPC();
     InterruptRPC();
@@ -203,6 +207,10 @@ void Shutdown()
     StopREST();
     StopRPC();
     StopHTTPServer();
+    if (g_templatebroadcaster) {
+        UnregisterValidationInterface(g_templatebroadcaster.get());
+        g_templatebroadcaster.reset();
+    }
 #ifdef ENABLE_WALLET
     // Dogecoin 1.14 TODO: ShutdownRPCMining();
     if (pwalletMain)
@@ -233,15 +241,21 @@ void Shutdown()
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
+            if (fFlatBlockIndex)
+                WriteFlatBlockIndex();
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsflusher;
+        pcoinsflusher = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete ppowcache;
+        ppowcache = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -343,9 +357,13 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-deferredsigchecks", strprintf("Verify the signatures of a block together after running its scripts, when using more than one script verification thread (default: %u)", DEFAULT_DEFERRED_SIG_CHECKS));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt("-flatblockindex", strprintf(_("Keep a copy of the block index in blocks/index.dat, written on shutdown, and build the block index from it on startup (default: %u)"), DEFAULT_FLATBLOCKINDEX));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadsnapshot=<file>", _("Imports a UTXO set snapshot written by dumptxoutset on startup, skipping the download of the blocks below it. Its block header must already be known (requires -snapshothash)"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
@@ -355,10 +373,12 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-powcache", strprintf(_("Remember the proof of work hashes of checked headers, so they are not recomputed on restart or reindex (default: %u)"), DEFAULT_POWCACHE));
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
+    strUsage += HelpMessageOpt("-snapshothash=<hex>", _("Expected hash_serialized_2 (as reported by gettxoutsetinfo) of the -loadsnapshot file"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
@@ -391,6 +411,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-rpcserialversion", strprintf(_("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)"), DEFAULT_RPC_SERIALIZE_VERSION));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+#ifdef USE_EPOLL
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), "select, epoll", DEFAULT_SOCKETEVENTS));
+#else
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), "select", DEFAULT_SOCKETEVENTS));
+#endif
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -418,12 +443,15 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashtemplate=<address>", _("Enable publish hash of new block templates in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawtemplate=<address>", _("Enable publish raw new block templates in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
     strUsage += HelpMessageOpt("-uacomment=<cmt>", _("Append comment to the user agent string"));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-backgroundflush", strprintf("Write the coins cache to disk in a separate thread while validation continues (default: %u)", DEFAULT_BACKGROUND_FLUSH));
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
@@ -456,7 +484,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"),
@@ -813,6 +841,7 @@ int nMaxConnections;
 int nUserMaxConnections;
 int nFD;
 int nAvailableFds;
+SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
 ServiceFlags nLocalServices = NODE_NETWORK;
 
 }
@@ -908,8 +937,14 @@ bool AppInitParameterInteraction()
     nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
-    // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+    std::string strSocketEventsMode = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (!ParseSocketEventsMode(strSocketEventsMode, socketEventsMode))
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified"), strSocketEventsMode));
+
+    // Trim requested connection counts, to fit into system limitations.
+    // Only select() is limited to descriptors below FD_SETSIZE.
+    if (socketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -955,6 +990,7 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fFlatBlockIndex = GetBoolArg("-flatblockindex", DEFAULT_FLATBLOCKINDEX);
 
     hashAssumeValid = uint256S(GetArg("-assumevalid", chainparams.GetConsensus(0).defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -979,6 +1015,7 @@ bool AppInitParameterInteraction()
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    fDeferSigChecks = GetBoolArg("-deferredsigchecks", DEFAULT_DEFERRED_SIG_CHECKS);
     if (nScriptCheckThreads <= 0)
         nScriptCheckThreads += GetNumCores();
     if (nScriptCheckThreads <= 1)
@@ -1187,6 +1224,9 @@ bool AppInitSanityChecks()
 {
     // ********************************************************* Step 4: sanity checks
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     RandomInit();
     ECC_Start();
@@ -1233,11 +1273,20 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     InitSignatureCache();
+    InitScriptExecutionCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadSigVerify);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadBlockReadAhead);
     }
 
     // Start the lightweight task scheduler thread
@@ -1265,6 +1314,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf("scrypt: using generic implementation\n");
     }
 #endif
+    LogPrintf("scrypt: using %s batch implementation\n", scrypt_detect_batch());
 
     // ********************************************************* Step 5: verify wallet database integrity
 #ifdef ENABLE_WALLET
@@ -1465,6 +1515,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nPoWCacheDBCache = GetBoolArg("-powcache", DEFAULT_POWCACHE) ? std::min(nTotalCache / 8, nMaxPoWCacheDBCache << 20) : 0;
+    nTotalCache -= nPoWCacheDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1472,9 +1524,15 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (nPoWCacheDBCache)
+        LogPrintf("* Using %.1fMiB for proof of work hash cache database\n", nPoWCacheDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
+    // The PoW hash cache is keyed by header content, so it survives -reindex
+    if (nPoWCacheDBCache)
+        ppowcache = new CPoWCacheDB(nPoWCacheDBCache);
+
     bool fLoaded = false;
     while (!fLoaded) {
         bool fReset = fReindex;
@@ -1487,6 +1545,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsflusher;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
@@ -1494,7 +1553,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsflusher = new CCoinsViewFlusher(pcoinscatcher, pcoinsdbview);
+                pcoinsTip = new CCoinsViewCache(pcoinsflusher);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1527,11 +1587,25 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
-                if (fHavePruned && !fPruneMode) {
+                if (fHavePruned && !fPruneMode && !fHaveSnapshot) {
                     strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
 
+                // At this point the block tree database is consistent with the
+                // arguments; migrate any per-transaction chainstate records.
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
+                // The blocks below a UTXO snapshot were never downloaded, so
+                // the chain state cannot be rebuilt from them.
+                if (fReindexChainState && fHaveSnapshot) {
+                    strLoadError = _("You need to rebuild the database using -reindex to rebuild the chain state of a node loaded from a UTXO snapshot");
+                    break;
+                }
+
                 if (!fReindex && chainActive.Tip() != NULL) {
                     uiInterface.InitMessage(_("Rewinding blocks..."));
                     if (!RewindBlockIndex(chainparams)) {
@@ -1602,6 +1676,30 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    if (IsArgSet("-loadsnapshot")) {
+        if (fHaveSnapshot) {
+            LogPrintf("Ignoring -loadsnapshot: the chain state was already loaded from a UTXO snapshot\n");
+        } else {
+            std::string strHash = GetArg("-snapshothash", "");
+            if (strHash.size() != 64 || !IsHex(strHash))
+                return InitError(_("-loadsnapshot requires -snapshothash to be set to the snapshot's hash"));
+            if (fReindex)
+                return InitError(_("-loadsnapshot cannot be combined with -reindex"));
+            uiInterface.InitMessage(_("Loading UTXO snapshot..."));
+            CValidationState state;
+            CUTXOSnapshotMetadata metadata;
+            if (!LoadUTXOSnapshot(state, chainparams, fs::absolute(GetArg("-loadsnapshot", ""), GetDataDir()), uint256S(strHash), metadata))
+                return InitError(strprintf(_("Unable to load UTXO snapshot: %s"), state.GetRejectReason()));
+        }
+    }
+
+    uiInterface.InitMessage(_("Loading UTXO set hash..."));
+    if (!LoadUTXOSetHash())
+        return InitError(_("Error reading from database, shutting down."));
+
+    if (GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH))
+        threadGroup.create_thread(&ThreadFlushCoins);
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1628,6 +1726,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
             uiInterface.InitMessage(_("Pruning blockstore..."));
             PruneAndFlush();
         }
+    } else if (fHaveSnapshot) {
+        LogPrintf("Unsetting NODE_NETWORK after loading a UTXO snapshot\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
     }
 
     if (chainparams.GetConsensus(0).vDeployments[Consensus::DEPLOYMENT_SEGWIT].nTimeout != 0) {
@@ -1705,6 +1806,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
+    connOptions.socketEventsMode = socketEventsMode;
 
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return InitError(strNodeError);
@@ -1713,6 +1815,15 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // Dogecoin: Do we need to do any RPC mining init here?
 
+    // Shared block template for REST long polling and ZMQ. It is only kept
+    // up to date once someone asks for it, unless ZMQ publishes it.
+    const bool fPublishTemplates = IsArgSet("-zmqpubhashtemplate") || IsArgSet("-zmqpubrawtemplate");
+    if (GetBoolArg("-rest", DEFAULT_REST_ENABLE) || fPublishTemplates) {
+        g_templatebroadcaster.reset(new CTemplateBroadcaster(&scheduler, fPublishTemplates));
+        RegisterValidationInterface(g_templatebroadcaster.get());
+        scheduler.scheduleEvery(boost::bind(&CTemplateBroadcaster::Refresh, g_templatebroadcaster.get()), TEMPLATE_CHECK_INTERVAL);
+    }
+
     SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading"));
 
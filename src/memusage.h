@@ -17,6 +17,9 @@
 #include <boost/unordered_set.hpp>
 #include <boost/unordered_map.hpp>
 
+template <typename T, size_t MAX_BLOCK_SIZE_BYTES>
+class PoolAllocator;
+
 namespace memusage
 {
 
@@ -167,6 +170,13 @@ static inline size_t DynamicUsage(const boost::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(boost_unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename E, size_t N>
+static inline size_t DynamicUsage(const boost::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, N> >& m)
+{
+    // The pool knows exactly what it allocated, nodes and buckets alike.
+    return m.get_allocator().DynamicMemoryUsage();
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
@@ -7,8 +7,11 @@
 
 #include "hash.h"
 #include "consensus/consensus.h"
+#include "crypto/sha256.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+
 CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
 {
     header = block.GetBlockHeader();
@@ -59,20 +62,17 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
 }
 
 uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
-    if (height == 0) {
-        // hash at height 0 is the txids themself
-        return vTxid[pos];
-    } else {
-        // calculate left hash
-        uint256 left = CalcHash(height-1, pos*2, vTxid), right;
-        // calculate right hash if not beyond the end of the array - copy left hash otherwise
-        if (pos*2+1 < CalcTreeWidth(height-1))
-            right = CalcHash(height-1, pos*2+1, vTxid);
-        else
-            right = left;
-        // combine subhashes
-        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+    // Hash the subtree level by level, from the txids it covers, all pairs of
+    // a level at once. At the end of a level with an odd number of nodes, the
+    // last one is hashed with itself.
+    std::vector<uint256> vLevel(vTxid.begin() + (pos << height), vTxid.begin() + std::min((pos+1) << height, nTransactions));
+    for (int i = 0; i < height; i++) {
+        if (vLevel.size() & 1)
+            vLevel.push_back(vLevel.back());
+        SHA256D64(vLevel[0].begin(), vLevel[0].begin(), vLevel.size() / 2);
+        vLevel.resize(vLevel.size() / 2);
     }
+    return vLevel[0];
 }
 
 void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) {
@@ -28,6 +28,7 @@
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -634,6 +635,181 @@ void BlockAssembler::addPriorityTxs()
     fNeedSizeAccounting = fSizeAccounting;
 }
 
+IncrementalBlockAssembler::IncrementalBlockAssembler(const CChainParams& _chainparams, bool fMineWitnessTxIn)
+    : BlockAssembler(_chainparams), fMineWitnessTx(fMineWitnessTxIn), fStale(true), pindexPrev(nullptr), nTransactionsUpdatedLast(0)
+{
+    pblock = nullptr;
+    connAdded = mempool.NotifyEntryAdded.connect(boost::bind(&IncrementalBlockAssembler::TransactionAddedToMempool, this, _1));
+    connRemoved = mempool.NotifyEntryRemoved.connect(boost::bind(&IncrementalBlockAssembler::TransactionRemovedFromMempool, this, _1, _2));
+}
+
+void IncrementalBlockAssembler::TransactionAddedToMempool(CTransactionRef tx)
+{
+    // The entry is not in mapTx yet, so it is looked at by the next request
+    LOCK(cs);
+    if (fStale)
+        return;
+    vPending.push_back(tx);
+    ++nTransactionsUpdatedLast;
+}
+
+void IncrementalBlockAssembler::TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (fStale)
+        return;
+    if (reason == MemPoolRemovalReason::BLOCK) {
+        // A new tip is on its way, which takes a full selection anyway
+        fStale = true;
+        vPending.clear();
+        return;
+    }
+    RemoveTransaction(*tx);
+    ++nTransactionsUpdatedLast;
+}
+
+void IncrementalBlockAssembler::Rebuild()
+{
+    fStale = true;
+    vPending.clear();
+    setSelected.clear();
+
+    // Keep the block BlockAssembler leaves behind, to follow the mempool from
+    pblocktemplate = BlockAssembler::CreateNewBlock(CScript(), fMineWitnessTx);
+    pblock = &pblocktemplate->block;
+    // The selection is tracked by txid from here on, as inBlock's entries
+    // do not outlive their removal from the mempool
+    inBlock.clear();
+    for (size_t i = 1; i < pblock->vtx.size(); i++)
+        setSelected.insert(pblock->vtx[i]->GetHash());
+
+    pindexPrev = chainActive.Tip();
+    nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+    fStale = false;
+}
+
+bool IncrementalBlockAssembler::AppendTransaction(CTxMemPool::txiter iter)
+{
+    const CTransaction& tx = iter->GetTx();
+    if (setSelected.count(tx.GetHash()))
+        return true;
+
+    // Only a transaction whose in-mempool parents are already in the block
+    // can go at its end. Otherwise, if its package pays enough to be
+    // selected, the parents have to be selected with it.
+    BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter)) {
+        if (!setSelected.count(parent->GetTx().GetHash()))
+            return iter->GetModFeesWithAncestors() < blockMinFeeRate.GetFee(iter->GetSizeWithAncestors());
+    }
+
+    // Transactions a full selection would not include either
+    if (iter->GetModifiedFee() < blockMinFeeRate.GetFee(iter->GetTxSize()))
+        return true;
+    if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
+        return true;
+    if (!fIncludeWitness && tx.HasWitness())
+        return true;
+
+    CTxMemPool::setEntries package;
+    package.insert(iter);
+    if (!TestPackage(iter->GetTxSize(), iter->GetSigOpCost()) || !TestPackageTransactions(package))
+        return false;
+
+    AddToBlock(iter);
+    inBlock.clear();
+    setSelected.insert(tx.GetHash());
+    return true;
+}
+
+void IncrementalBlockAssembler::RemoveTransaction(const CTransaction& tx)
+{
+    if (!setSelected.erase(tx.GetHash()))
+        return;
+
+    for (size_t i = 1; i < pblock->vtx.size(); i++) {
+        if (pblock->vtx[i]->GetHash() != tx.GetHash())
+            continue;
+        if (fNeedSizeAccounting)
+            nBlockSize -= ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        nBlockWeight -= GetTransactionWeight(tx);
+        --nBlockTx;
+        nBlockSigOpsCost -= pblocktemplate->vTxSigOpsCost[i];
+        nFees -= pblocktemplate->vTxFees[i];
+        pblock->vtx.erase(pblock->vtx.begin() + i);
+        pblocktemplate->vTxFees.erase(pblocktemplate->vTxFees.begin() + i);
+        pblocktemplate->vTxSigOpsCost.erase(pblocktemplate->vTxSigOpsCost.begin() + i);
+        return;
+    }
+    assert(false); // every selected transaction is in the block
+}
+
+std::unique_ptr<CBlockTemplate> IncrementalBlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+
+    size_t nAppended = 0;
+    if (!fStale && (pindexPrev != chainActive.Tip() || mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast))
+        fStale = true;
+    for (size_t i = 0; !fStale && i < vPending.size(); i++) {
+        CTxMemPool::txiter iter = mempool.mapTx.find(vPending[i]->GetHash());
+        // Gone again (then taken out of the block by its removal signal)
+        if (iter == mempool.mapTx.end())
+            continue;
+        if (!AppendTransaction(iter))
+            fStale = true;
+        ++nAppended;
+    }
+    vPending.clear();
+
+    const bool fRebuild = fStale;
+    if (fRebuild)
+        Rebuild();
+
+    nLastBlockTx = nBlockTx;
+    nLastBlockSize = nBlockSize;
+    nLastBlockWeight = nBlockWeight;
+
+    // Pay the template's coinbase to scriptPubKeyIn
+    const Consensus::Params& consensus = chainparams.GetConsensus(nHeight);
+    std::unique_ptr<CBlockTemplate> pnewtemplate(new CBlockTemplate(*pblocktemplate));
+    CBlock& block = pnewtemplate->block;
+    CMutableTransaction coinbaseTx(*block.vtx[0]);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = nFees + GetDogecoinBlockSubsidy(nHeight, consensus, pindexPrev->GetBlockHash());
+    // The witness commitment covers the transactions, so it is made afresh
+    coinbaseTx.vout.resize(1);
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    if (!pnewtemplate->vchCoinbaseCommitment.empty())
+        pnewtemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(block, pindexPrev, consensus);
+    pnewtemplate->vTxFees[0] = -nFees;
+    pnewtemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*block.vtx[0]);
+    UpdateTime(&block, consensus, pindexPrev);
+
+    LogPrint("bench", "IncrementalBlockAssembler: %s, %u new transactions looked at, %u txs in block (%.2fms)\n",
+             fRebuild ? "rebuilt" : "updated", nAppended, nBlockTx, 0.001 * (GetTimeMicros() - nTimeStart));
+
+    return pnewtemplate;
+}
+
+std::unique_ptr<CBlockTemplate> CreateIncrementalBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+{
+    // Destroyed before the mempool whose signals it is connected to
+    static std::unique_ptr<IncrementalBlockAssembler> passembler;
+    static const CChainParams* pchainparams = nullptr;
+    static bool fAssemblerMinesWitnessTx = false;
+
+    LOCK(cs_main);
+    if (!passembler || pchainparams != &chainparams || fAssemblerMinesWitnessTx != fMineWitnessTx) {
+        passembler.reset(new IncrementalBlockAssembler(chainparams, fMineWitnessTx));
+        pchainparams = &chainparams;
+        fAssemblerMinesWitnessTx = fMineWitnessTx;
+    }
+    return passembler->CreateNewBlock(scriptPubKeyIn);
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -12,6 +12,7 @@
 
 #include <stdint.h>
 #include <memory>
+#include <set>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
@@ -134,7 +135,7 @@ struct update_for_parent_inclusion
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
-private:
+protected:
     // The constructed block template
     std::unique_ptr<CBlockTemplate> pblocktemplate;
     // A convenience pointer that always refers to the CBlock in pblocktemplate
@@ -168,7 +169,7 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx);
 
-private:
+protected:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
@@ -210,6 +211,63 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Block template kept in step with the mempool.
+ *
+ * After a full selection by BlockAssembler it follows the mempool's
+ * NotifyEntryAdded and NotifyEntryRemoved signals: transactions whose
+ * in-mempool parents are all in the block are appended to it if they fit,
+ * and removed transactions are taken out again, so that a request only pays
+ * for the mempool changes since the previous one. A full selection is run
+ * again for a new tip, when the mempool changed in a way the signals do not
+ * report (a fee delta, a clear), or when a transaction which pays the block
+ * minimum fee could not be appended, as it may be worth more than some of
+ * the selected ones.
+ */
+class IncrementalBlockAssembler : private BlockAssembler
+{
+private:
+    // Guards the members below, and the block state of BlockAssembler.
+    // Taken after mempool.cs.
+    CCriticalSection cs;
+
+    bool fMineWitnessTx;
+    // Whether the template has to be rebuilt before it can be used again
+    bool fStale;
+    // The tip the template builds on
+    const CBlockIndex* pindexPrev;
+    // The mempool's update counter as of the last signal seen
+    unsigned int nTransactionsUpdatedLast;
+    // Transactions added to the mempool since the template was last updated
+    std::vector<CTransactionRef> vPending;
+    std::set<uint256> setSelected;
+
+    boost::signals2::scoped_connection connAdded;
+    boost::signals2::scoped_connection connRemoved;
+
+    void TransactionAddedToMempool(CTransactionRef tx);
+    void TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    /** Run a full transaction selection for the current tip */
+    void Rebuild();
+    /** Try to append a mempool transaction; false if a full selection is needed instead */
+    bool AppendTransaction(CTxMemPool::txiter iter);
+    /** Take a transaction back out of the block, if it is in it */
+    void RemoveTransaction(const CTransaction& tx);
+
+public:
+    IncrementalBlockAssembler(const CChainParams& chainparams, bool fMineWitnessTx);
+
+    /** Return a copy of the current template, with coinbase to scriptPubKeyIn */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
+};
+
+/**
+ * Construct a new block template with coinbase to scriptPubKeyIn from a
+ * shared IncrementalBlockAssembler, which is set up by the first call.
+ */
+std::unique_ptr<CBlockTemplate> CreateIncrementalBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn, bool fMineWitnessTx);
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -29,6 +29,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -45,6 +49,17 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// With epoll, the socket handler only wakes up for socket events, or at this
+// interval (in milliseconds) to disconnect peers and check for inactivity.
+#define SOCKET_EVENTS_IDLE_TIMEOUT 1000
+
+// Interval (in milliseconds) to recheck peers with unread data whose receive
+// side is paused, until the message handler has caught up.
+#define SOCKET_EVENTS_PAUSED_TIMEOUT 50
+
+// Maximum number of socket events handled per epoll_wait() call.
+#define MAX_SOCKET_EVENTS 1024
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -360,7 +375,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -833,7 +848,7 @@ size_t CConnman::SocketSendData(CNode *pnode) const
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
+        const auto &data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = 0;
         {
@@ -1059,7 +1074,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1102,6 +1117,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint("net", "connection from %s accepted\n", addr.ToString());
 
+    RegisterSocketEvents(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1158,6 +1174,270 @@ void CConnman::DeleteDisconnectedNodes()
     }
 }
 
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode)
+{
+    if (strMode == "select") {
+        mode = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef USE_EPOLL
+    if (strMode == "epoll") {
+        mode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+bool CConnman::InitSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode != SOCKETEVENTS_EPOLL)
+        return true;
+
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        LogPrintf("%s: epoll_create1 failed: %s\n", __func__, NetworkErrorString(errno));
+        return false;
+    }
+    if (pipe2(wakeupPipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        wakeupPipe[0] = wakeupPipe[1] = -1;
+        LogPrintf("%s: pipe2 failed: %s\n", __func__, NetworkErrorString(errno));
+        return false;
+    }
+
+    // The wake-up pipe and listening sockets are level-triggered: a wake-up
+    // is drained at once, and only one connection is accepted per round.
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = wakeupPipe[0];
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeupPipe[0], &event) != 0) {
+        LogPrintf("%s: epoll_ctl failed: %s\n", __func__, NetworkErrorString(errno));
+        return false;
+    }
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        event.events = EPOLLIN;
+        event.data.fd = hListenSocket.socket;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("%s: epoll_ctl failed: %s\n", __func__, NetworkErrorString(errno));
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+void CConnman::ShutdownSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (wakeupPipe[i] != -1) {
+            close(wakeupPipe[i]);
+            wakeupPipe[i] = -1;
+        }
+    }
+#endif
+}
+
+void CConnman::RegisterSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode != SOCKETEVENTS_EPOLL || epollfd == -1)
+        return;
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+
+    // Peer sockets are edge-triggered for both directions, so the registration
+    // never has to be modified. Closing the socket removes it from the set.
+    // Data may arrive before the peer is added to vNodes, when an event for it
+    // would be dropped, so try reading once instead of waiting for the first one.
+    pnode->fHasRecvData = true;
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = pnode->hSocket;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("%s: epoll_ctl failed for peer=%d: %s\n", __func__, pnode->id, NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
+void CConnman::WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (wakeupPipe[1] == -1)
+        return;
+
+    char buf = 0;
+    ssize_t nWritten = write(wakeupPipe[1], &buf, 1);
+    // A full pipe means a wake-up is pending already.
+    (void)nWritten;
+#endif
+}
+
+void CConnman::SocketEventsSelect(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+    std::vector<SOCKET> vSockets;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+        vSockets.push_back(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+            vSockets.push_back(pnode->hSocket);
+
+            if (select_send) {
+                FD_SET(pnode->hSocket, &fdsetSend);
+                continue;
+            }
+            if (select_recv) {
+                FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+            return;
+    }
+
+    BOOST_FOREACH(SOCKET hSocket, vSockets) {
+        if (FD_ISSET(hSocket, &fdsetRecv))
+            recv_set.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetSend))
+            send_set.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetError))
+            error_set.insert(hSocket);
+    }
+}
+
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    // Peer sockets are edge-triggered, so a peer whose receive buffer was not
+    // drained yet has to be serviced again without waiting for a new event.
+    // Sends are only retried on a new event: data is queued only after an
+    // optimistic send did not complete, which guarantees one will follow.
+    int nTimeout = SOCKET_EVENTS_IDLE_TIMEOUT;
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->fHasRecvData)
+                nTimeout = std::min(nTimeout, pnode->fPauseRecv ? SOCKET_EVENTS_PAUSED_TIMEOUT : 0);
+        }
+    }
+
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, MAX_SOCKET_EVENTS, nTimeout);
+    if (interruptNet)
+        return;
+
+    if (nEvents < 0) {
+        int nErr = errno;
+        if (nErr != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_PAUSED_TIMEOUT)))
+                return;
+        }
+        nEvents = 0;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        SOCKET hSocket = events[i].data.fd;
+        if (hSocket == (SOCKET)wakeupPipe[0]) {
+            char buf[128];
+            while (read(wakeupPipe[0], buf, sizeof(buf)) > 0) {}
+            continue;
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            error_set.insert(hSocket);
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP))
+            recv_set.insert(hSocket);
+        if (events[i].events & EPOLLOUT)
+            send_set.insert(hSocket);
+    }
+
+    // Fold the new events into each peer's receive state, and only hand out
+    // peers with unread data that are not paused.
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes) {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (recv_set.count(pnode->hSocket))
+            pnode->fHasRecvData = true;
+        if (pnode->fHasRecvData && !pnode->fPauseRecv)
+            recv_set.insert(pnode->hSocket);
+        else
+            recv_set.erase(pnode->hSocket);
+    }
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1186,91 +1466,22 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::set<SOCKET> recv_set, send_set, error_set;
+#ifdef USE_EPOLL
+        if (socketEventsMode == SOCKETEVENTS_EPOLL)
+            SocketEventsEpoll(recv_set, send_set, error_set);
+        else
+#endif
+            SocketEventsSelect(recv_set, send_set, error_set);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1304,9 +1515,9 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = recv_set.count(pnode->hSocket);
+                sendSet = send_set.count(pnode->hSocket);
+                errorSet = error_set.count(pnode->hSocket);
             }
             if (recvSet || errorSet)
             {
@@ -1321,6 +1532,9 @@ void CConnman::ThreadSocketHandler()
                                 continue;
                             nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                         }
+                        // A short read drained the receive buffer; wait for the next event
+                        if (nBytes < (int)sizeof(pchBuf))
+                            pnode->fHasRecvData = false;
                         if (nBytes > 0)
                         {
                             bool notify = false;
@@ -2011,6 +2225,7 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->fAddnode = true;
 
     GetNodeSignals().InitializeNode(pnode, *this);
+    RegisterSocketEvents(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -2253,6 +2468,11 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nReceiveFloodSize = 0;
     semOutbound = NULL;
     semAddnode = NULL;
+    socketEventsMode = SOCKETEVENTS_SELECT;
+#ifdef USE_EPOLL
+    epollfd = -1;
+    wakeupPipe[0] = wakeupPipe[1] = -1;
+#endif
     nMaxConnections = 0;
     nMaxOutbound = 0;
     nAvailableFds = 0;
@@ -2286,6 +2506,8 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
     nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
 
+    socketEventsMode = connOptions.socketEventsMode;
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
@@ -2347,6 +2569,12 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         fMsgProcWake = false;
     }
 
+    if (!InitSocketEvents()) {
+        LogPrintf("Falling back to select() for socket events\n");
+        ShutdownSocketEvents();
+        socketEventsMode = SOCKETEVENTS_SELECT;
+    }
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2395,6 +2623,7 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    WakeSocketHandler();
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2447,6 +2676,7 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    ShutdownSocketEvents();
     delete semOutbound;
     semOutbound = NULL;
     delete semAddnode;
@@ -2766,6 +2996,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nextSendTimeFeeFilter = 0;
     fPauseRecv = false;
     fPauseSend = false;
+    fHasRecvData = false;
     nProcessQueueSize = 0;
     nPendingHeaderRequests = 0;
 
@@ -2792,11 +3023,9 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+CSharedNetMsg MakeSharedNetMsg(CSerializedNetMsg&& msg)
 {
     size_t nMessageSize = msg.data.size();
-    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-    LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
@@ -2806,6 +3035,24 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
+    CSharedNetMsg shared;
+    shared.command = std::move(msg.command);
+    shared.header = std::make_shared<const std::vector<unsigned char> >(std::move(serializedHeader));
+    shared.data = std::make_shared<const std::vector<unsigned char> >(std::move(msg.data));
+    return shared;
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    PushMessage(pnode, MakeSharedNetMsg(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.data->size();
+    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+    LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
+
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
@@ -2817,9 +3064,9 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(msg.header);
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.data);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
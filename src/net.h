@@ -26,12 +26,17 @@
 #include <stdint.h>
 #include <thread>
 #include <memory>
+#include <set>
 #include <condition_variable>
 
 #ifndef WIN32
 #include <arpa/inet.h>
 #endif
 
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+
 #include <boost/foreach.hpp>
 #include <boost/signals2/signal.hpp>
 
@@ -88,6 +93,18 @@ static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
+/** Ways for the socket handler thread to wait for socket events */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_EPOLL,
+};
+/** -socketevents default */
+#ifdef USE_EPOLL
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
@@ -105,6 +122,9 @@ class CTransaction;
 class CNodeStats;
 class CClientUIInterface;
 
+/** Serialized message data, which can be queued for any number of peers */
+typedef std::shared_ptr<const std::vector<unsigned char> > CSharedNetBuffer;
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -118,6 +138,19 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/**
+ * A message with its header serialized once, so the same buffers can be sent
+ * to many peers without copying or hashing the payload again.
+ */
+struct CSharedNetMsg
+{
+    std::string command;
+    CSharedNetBuffer header;
+    CSharedNetBuffer data;
+};
+
+CSharedNetMsg MakeSharedNetMsg(CSerializedNetMsg&& msg);
+
 
 class CConnman
 {
@@ -145,6 +178,7 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        SocketEventsMode socketEventsMode = SOCKETEVENTS_SELECT;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -160,6 +194,7 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     template<typename Callable>
     void ForEachNode(Callable&& func)
@@ -301,6 +336,14 @@ private:
     void ThreadOpenConnections();
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    bool InitSocketEvents();
+    void ShutdownSocketEvents();
+    void RegisterSocketEvents(CNode* pnode);
+    void WakeSocketHandler();
+    void SocketEventsSelect(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#ifdef USE_EPOLL
+    void SocketEventsEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -403,6 +446,15 @@ private:
 
     CThreadInterrupt interruptNet;
 
+    /** How the socket handler waits for socket events */
+    SocketEventsMode socketEventsMode;
+#ifdef USE_EPOLL
+    /** epoll instance watching all sockets, in SOCKETEVENTS_EPOLL mode */
+    int epollfd;
+    /** Pipe registered with epollfd to wake up the socket handler */
+    int wakeupPipe[2];
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
@@ -414,6 +466,7 @@ void Discover(boost::thread_group& threadGroup);
 void MapPort(bool fUseUPnP);
 unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode);
 
 struct CombinerAll
 {
@@ -576,7 +629,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CSharedNetBuffer> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -626,6 +679,10 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Edge-triggered socket events only report new data once, so remember
+    // that the receive buffer may not be drained yet. Only used by the
+    // socket handler thread.
+    bool fHasRecvData;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
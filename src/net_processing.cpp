@@ -859,6 +859,12 @@ static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
 static uint256 most_recent_block_hash;
 
+/** Number of serialized blocks kept around for serving getdata requests */
+static const unsigned int MAX_RAW_BLOCK_CACHE_ENTRIES = 8;
+static CCriticalSection cs_raw_block_cache;
+/** Most recently served block messages, in most recently used order */
+static std::list<std::pair<uint256, CSharedNetMsg> > raw_block_cache;
+
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
@@ -987,12 +993,13 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                 recentRejects->reset();
             }
 
-            // Use pcoinsTip->HaveCoinsInCache as a quick approximation to exclude
+            // Use pcoinsTip->HaveCoinInCache as a quick approximation to exclude
             // requesting or processing some txs which have already been included in a block
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoinsInCache(inv.hash);
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
     case MSG_BLOCK:
     case MSG_WITNESS_BLOCK:
@@ -1047,6 +1054,38 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connma
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/**
+ * Get a block message for pindex built directly from its serialization on
+ * disk. Recently served blocks are shared between peers, so relaying the same
+ * block to many of them reads and hashes it only once.
+ */
+static bool GetRawBlockMessage(const CBlockIndex* pindex, CSharedNetMsg& msg)
+{
+    const uint256& hash = pindex->GetBlockHash();
+    {
+        LOCK(cs_raw_block_cache);
+        for (auto it = raw_block_cache.begin(); it != raw_block_cache.end(); ++it) {
+            if (it->first == hash) {
+                raw_block_cache.splice(raw_block_cache.begin(), raw_block_cache, it);
+                msg = it->second;
+                return true;
+            }
+        }
+    }
+
+    CSerializedNetMsg serialized;
+    serialized.command = NetMsgType::BLOCK;
+    if (!ReadRawBlockFromDisk(serialized.data, pindex, Params().MessageStart()))
+        return false;
+    msg = MakeSharedNetMsg(std::move(serialized));
+
+    LOCK(cs_raw_block_cache);
+    raw_block_cache.emplace_front(hash, msg);
+    if (raw_block_cache.size() > MAX_RAW_BLOCK_CACHE_ENTRIES)
+        raw_block_cache.pop_back();
+    return true;
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -1117,11 +1156,17 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
+                    // Full blocks without witness data can be sent exactly as stored on disk
+                    const bool fSendRaw = inv.type == MSG_WITNESS_BLOCK ||
+                        (inv.type == MSG_BLOCK && !IsWitnessEnabled(mi->second->pprev, consensusParams));
+                    CSharedNetMsg rawBlockMsg;
                     // Send block from disk
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams, false))
+                    if (fSendRaw && GetRawBlockMessage(mi->second, rawBlockMsg))
+                        connman.PushMessage(pfrom, rawBlockMsg);
+                    else if (!ReadBlockFromDisk(block, (*mi).second, consensusParams, false))
                         assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
+                    else if (inv.type == MSG_BLOCK)
                         connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block));
                     else if (inv.type == MSG_WITNESS_BLOCK)
                         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
@@ -1995,17 +2040,25 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-
         bool fMissingInputs = false;
         CValidationState state;
+        std::list<CTransactionRef> lRemovedTxn;
 
-        // Mark the tx as received
-        g_txrequest.ReceivedResponse(pfrom->GetId(), inv.hash);
+        bool fAlreadyHave;
+        {
+            LOCK(cs_main);
+            // Mark the tx as received
+            g_txrequest.ReceivedResponse(pfrom->GetId(), inv.hash);
+            fAlreadyHave = AlreadyHave(inv);
+        }
 
-        std::list<CTransactionRef> lRemovedTxn;
+        // Check the transaction's scripts without holding cs_main, so RPC
+        // and the rest of the node are not held up by them
+        const bool fAccepted = !fAlreadyHave && AcceptToMemoryPoolUnlocked(mempool, state, ptx, true, &fMissingInputs, &lRemovedTxn);
+
+        LOCK(cs_main);
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, &lRemovedTxn)) {
+        if (fAccepted) {
             mempool.check(pcoinsTip);
 
             // As this version of the transaction was acceptable, we can forget
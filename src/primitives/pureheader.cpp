@@ -28,3 +28,15 @@ uint256 CPureBlockHeader::GetPoWHash() const
     scrypt_1024_1_1_256(BEGIN(nVersion), BEGIN(thash));
     return thash;
 }
+
+void CPureBlockHeader::GetPoWHashes(const std::vector<const CPureBlockHeader*>& vHeaders, std::vector<uint256>& vHashes)
+{
+    std::vector<const char*> vInput(vHeaders.size());
+    std::vector<char*> vOutput(vHeaders.size());
+    vHashes.resize(vHeaders.size());
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        vInput[i] = BEGIN(vHeaders[i]->nVersion);
+        vOutput[i] = BEGIN(vHashes[i]);
+    }
+    scrypt_1024_1_1_256_batch(vInput.data(), vOutput.data(), vHeaders.size());
+}
@@ -9,6 +9,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <vector>
+
 /**
  * A block header without auxpow information.  This "intermediate step"
  * in constructing the full header is useful, because it breaks the cyclic
@@ -70,6 +72,15 @@ public:
 
     uint256 GetPoWHash() const;
 
+    /**
+     * Compute the PoW hashes of several headers at once.  The headers are
+     * interleaved through the multi-lane scrypt kernel, which is much faster
+     * than calling GetPoWHash() on each of them in turn.
+     * @param vHeaders The headers to hash.
+     * @param vHashes Receives GetPoWHash() of each header, in the same order.
+     */
+    static void GetPoWHashes(const std::vector<const CPureBlockHeader*>& vHeaders, std::vector<uint256>& vHashes);
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -185,6 +185,28 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
     return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), &pubkey);
 }
 
+bool CParsedPubKey::Set(const CPubKey& pubkey) {
+    static_assert(sizeof(data) == sizeof(secp256k1_pubkey), "CParsedPubKey must hold a secp256k1_pubkey");
+    fValid = pubkey.IsValid() && secp256k1_ec_pubkey_parse(secp256k1_context_verify, (secp256k1_pubkey*)data, &pubkey[0], pubkey.size());
+    return fValid;
+}
+
+bool CParsedPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    if (!fValid)
+        return false;
+    secp256k1_ecdsa_signature sig;
+    if (vchSig.size() == 0) {
+        return false;
+    }
+    if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, &vchSig[0], vchSig.size())) {
+        return false;
+    }
+    /* libsecp256k1's ECDSA verification requires lower-S signatures, which have
+     * not historically been enforced in Bitcoin, so normalize them first. */
+    secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, &sig, &sig);
+    return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), (const secp256k1_pubkey*)data);
+}
+
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     if (vchSig.size() != CPubKey::SIZE)
         return false;
@@ -204,6 +204,31 @@ private:
 
 };
 
+/**
+ * A public key in the parsed form used for verification. Verifying many
+ * signatures with one CParsedPubKey parses (and for compressed keys,
+ * decompresses) the key only once.
+ */
+class CParsedPubKey
+{
+private:
+    //! Opaque secp256k1_pubkey
+    unsigned char data[64];
+    bool fValid;
+
+public:
+    CParsedPubKey() : fValid(false) {}
+    explicit CParsedPubKey(const CPubKey& pubkey) { Set(pubkey); }
+
+    //! Parse pubkey, returning whether it is fully valid
+    bool Set(const CPubKey& pubkey);
+
+    bool IsValid() const { return fValid; }
+
+    //! Verify a DER signature, with the same result as CPubKey::Verify
+    bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
+};
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
@@ -6,6 +6,7 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "core_io.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "validation.h"
@@ -13,6 +14,7 @@
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "templatebroadcast.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
@@ -41,16 +43,19 @@ static const struct {
 };
 
 struct CCoin {
-    uint32_t nTxVer; // Don't call this nVersion, that name has a special meaning inside IMPLEMENT_SERIALIZE
     uint32_t nHeight;
     CTxOut out;
 
     ADD_SERIALIZE_METHODS;
 
+    CCoin() : nHeight(0) {}
+    CCoin(Coin&& in) : nHeight(in.nHeight), out(std::move(in.out)) {}
+
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action)
     {
-        READWRITE(nTxVer);
+        uint32_t nTxVerDummy = 0;
+        READWRITE(nTxVerDummy);
         READWRITE(nHeight);
         READWRITE(out);
     }
@@ -62,6 +67,7 @@ extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern UniValue SendRawTransactions(const std::vector<CTransactionRef>& vtx, CAmount nMaxRawTxFee);
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, std::string message)
 {
@@ -520,25 +526,11 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         }
 
         for (size_t i = 0; i < vOutPoints.size(); i++) {
-            CCoins coins;
-            uint256 hash = vOutPoints[i].hash;
             bool hit = false;
-            if (view.GetCoins(hash, coins)) {
-                if (fCheckMemPool) {
-                    mempool.pruneSpent(hash, coins);
-                }
-
-                if (coins.IsAvailable(vOutPoints[i].n)) {
-                    hit = true;
-                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
-                    // n is valid but points to an already spent output (IsNull).
-                    CCoin coin;
-                    coin.nTxVer = coins.nVersion;
-                    coin.nHeight = coins.nHeight;
-                    coin.out = coins.vout.at(vOutPoints[i].n);
-                    assert(!coin.out.IsNull());
-                    outs.push_back(coin);
-                }
+            Coin coin;
+            if (view.GetCoin(vOutPoints[i], coin) && !(fCheckMemPool && mempool.isSpent(vOutPoints[i]))) {
+                hit = true;
+                outs.emplace_back(std::move(coin));
             }
 
             hits.push_back(hit);
@@ -582,7 +574,6 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         UniValue utxos(UniValue::VARR);
         BOOST_FOREACH (const CCoin& coin, outs) {
             UniValue utxo(UniValue::VOBJ);
-            utxo.pushKV("txvers", (int32_t)coin.nTxVer);
             utxo.pushKV("height", (int32_t)coin.nHeight);
             utxo.pushKV("value", ValueFromAmount(coin.out.nValue));
 
@@ -656,6 +647,120 @@ static bool rest_blockhash_by_height(HTTPRequest* req,
  }
 
 
+static void WriteBlockTemplate(HTTPRequest* req, RetFormat rf, const std::shared_ptr<const CSharedBlockTemplate>& ptemplate)
+{
+    if (!ptemplate) {
+        RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "No block template available");
+        return;
+    }
+    switch (rf) {
+    case RF_BINARY:
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, ptemplate->strBinary);
+        break;
+    case RF_HEX:
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, ptemplate->strHex);
+        break;
+    default:
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, ptemplate->strJSON);
+        break;
+    }
+}
+
+static bool rest_blocktemplate(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    if (!g_templatebroadcaster)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Block templates are not enabled");
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    if (param.empty()) {
+        WriteBlockTemplate(req, rf, g_templatebroadcaster->Get());
+        return true;
+    }
+
+    // Long poll: reply once there is a template other than the given one.
+    // The request is parked with the broadcaster rather than holding on to
+    // this worker thread.
+    uint256 hashKnown;
+    if (param[0] != '/' || !ParseHashStr(param.substr(1), hashKnown))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + SanitizeString(param.substr(1)));
+    std::shared_ptr<HTTPRequest> preq(req->Detach());
+    g_templatebroadcaster->Wait(hashKnown, [preq, rf](const std::shared_ptr<const CSharedBlockTemplate>& ptemplate) {
+        if (!ptemplate)
+            RESTERR(preq.get(), HTTP_SERVICE_UNAVAILABLE, "Shutting down");
+        else
+            WriteBlockTemplate(preq.get(), rf, ptemplate);
+    });
+    return true;
+}
+
+static bool rest_sendrawtransactions(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    if (req->GetRequestMethod() != HTTPRequest::POST)
+        return RESTERR(req, HTTP_BAD_METHOD, "Transactions must be sent with POST");
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (!param.empty())
+        return RESTERR(req, HTTP_NOT_FOUND, "Unknown request: " + SanitizeString(param));
+
+    // input-format: bin is a list of transactions serialized as in a block,
+    // hex the same hex-encoded, json an array of hex-encoded transactions.
+    // The result is JSON in any case.
+    std::string strRequest = req->ReadBody();
+    std::vector<CTransactionRef> vtx;
+    switch (rf) {
+    case RF_HEX: {
+        if (!IsHex(boost::trim_copy(strRequest)))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        std::vector<unsigned char> vRequest = ParseHex(strRequest);
+        strRequest.assign(vRequest.begin(), vRequest.end());
+    }
+    // Falls through
+
+    case RF_BINARY: {
+        try {
+            CDataStream ssRequest(strRequest.data(), strRequest.data() + strRequest.size(), SER_NETWORK, PROTOCOL_VERSION);
+            ssRequest >> vtx;
+            if (!ssRequest.empty())
+                return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        } catch (const std::ios_base::failure& e) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        }
+        break;
+    }
+
+    case RF_JSON: {
+        UniValue hexstrings;
+        if (!hexstrings.read(strRequest) || !hexstrings.isArray())
+            return RESTERR(req, HTTP_BAD_REQUEST, "Parse error");
+        for (size_t i = 0; i < hexstrings.size(); i++) {
+            CMutableTransaction mtx;
+            if (!hexstrings[i].isStr() || !DecodeHexTx(mtx, hexstrings[i].get_str()))
+                return RESTERR(req, HTTP_BAD_REQUEST, strprintf("TX decode failed (index %u)", i));
+            vtx.push_back(MakeTransactionRef(std::move(mtx)));
+        }
+        break;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    std::string strJSON = SendRawTransactions(vtx, maxTxFee).write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -669,6 +774,8 @@ static const struct {
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
+      {"/rest/blocktemplate", rest_blocktemplate},
+      {"/rest/sendrawtransactions", rest_sendrawtransactions},
 };
 
 bool StartREST()
@@ -24,6 +24,7 @@
 #include "validationinterface.h"
 
 #include <stdint.h>
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -33,7 +34,8 @@ bool fUseNamecoinApi;
 
 static CCriticalSection cs_auxpowrpc;
 static CAuxBlockCache auxBlockCache;
-static std::vector<std::unique_ptr<CBlockTemplate>> vNewBlockTemplate;
+/** Template shared by the blocks for all coinbase scripts (guarded by cs_auxpowrpc) */
+static std::unique_ptr<CBlockTemplate> pAuxBlockTemplate;
 
 void AuxMiningCheck()
 {
@@ -56,6 +58,15 @@ void AuxMiningCheck()
     }
 }
 
+/** Whether block was built from blockTemplate, i.e. only differs from it in its coinbase. */
+static bool IsBuiltFromTemplate(const CBlock& block, const CBlock& blockTemplate)
+{
+    return block.hashPrevBlock == blockTemplate.hashPrevBlock
+        && block.nTime == blockTemplate.nTime
+        && block.vtx.size() == blockTemplate.vtx.size()
+        && std::equal(block.vtx.begin() + 1, block.vtx.end(), blockTemplate.vtx.begin() + 1);
+}
+
 static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
 {
     AuxMiningCheck();
@@ -73,6 +84,10 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
      * if we find a match. This allows for creating multiple aux templates with
      * a single dogecoind instance, for example when a pool runs multiple sub-
      * pools with different payout strategies.
+     *
+     * The transactions are selected once for all of them: the blocks for
+     * different scripts are copies of a shared template with their own
+     * coinbase and merkle root.
      */
     std::shared_ptr<CBlock> pblock;
     CScriptID scriptID (scriptPubKey);
@@ -80,8 +95,8 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
     {
         LOCK(cs_main);
 
-        // Update block
-        if (!pblock || pindexPrev != chainActive.Tip()
+        // Update the shared template
+        if (!pAuxBlockTemplate || pindexPrev != chainActive.Tip()
             || (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast
                 && GetTime() - nStart > 60))
         {
@@ -89,13 +104,13 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
             {
                 // Clear caches since they're obsolete now.
                 auxBlockCache.Reset();
-                vNewBlockTemplate.clear();
+                pAuxBlockTemplate.reset();
                 pblock.reset();
             }
 
-            // Create new block with nonce = 0 and extraNonce = 1
+            // Create new block with nonce = 0
             std::unique_ptr<CBlockTemplate> newBlock
-                = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, fMineWitnessTx);
+                = CreateIncrementalBlock(Params(), scriptPubKey, fMineWitnessTx);
             if (!newBlock)
                 throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
 
@@ -104,22 +119,28 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
             pindexPrev = chainActive.Tip();
             nStart = GetTime();
 
-            // Finalise it by setting the version and building the merkle root
-            IncrementExtraNonce(&newBlock->block, pindexPrev, nExtraNonce);
             newBlock->block.SetAuxpowFlag(true);
-
-            // Save
-            pblock = std::make_shared<CBlock>(newBlock->block);
-            auxBlockCache.Add(scriptID, pblock);
-            vNewBlockTemplate.push_back(std::move(newBlock));
+            pAuxBlockTemplate = std::move(newBlock);
         }
     }
 
-    // At this point, pblock is always initialised:  If we make it here
-    // without creating a new block above, it means that, in particular,
-    // pindexPrev == chainActive.Tip().  But for that to happen, we must
-    // already have created a pblock in a previous call, as pindexPrev is
-    // initialised only when pblock is.
+    if (!pblock || !IsBuiltFromTemplate(*pblock, pAuxBlockTemplate->block))
+    {
+        // Pay the template's coinbase to scriptPubKey, and finalise it by
+        // setting the extra nonce and building the merkle root
+        pblock = std::make_shared<CBlock>(pAuxBlockTemplate->block);
+        CMutableTransaction coinbaseTx(*pblock->vtx[0]);
+        coinbaseTx.vout[0].scriptPubKey = scriptPubKey;
+        pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+        IncrementExtraNonce(pblock.get(), pindexPrev, nExtraNonce);
+
+        // Save
+        auxBlockCache.Add(scriptID, pblock);
+    }
+
+    // At this point, pblock is always initialised:  It is either built from
+    // the shared template above, or a cached block built from that same
+    // template, so in particular pindexPrev is its parent.
     assert(pblock);
 
     arith_uint256 target;
@@ -20,6 +20,7 @@
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "undo.h"
 #include "util.h"
@@ -857,60 +858,6 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nSerializedSize;
-    uint256 hashSerialized;
-    arith_uint256 nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
-};
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    arith_uint256 nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        uint256 key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
-            stats.nTransactions++;
-            ss << key;
-            for (unsigned int i=0; i<coins.vout.size(); i++) {
-                const CTxOut &out = coins.vout[i];
-                if (!out.IsNull()) {
-                    stats.nTransactionOutputs++;
-                    ss << VARINT(i+1);
-                    ss << out;
-                    nTotalAmount += out.nValue;
-                }
-            }
-            stats.nSerializedSize += 32 + pcursor->GetValueSize();
-            ss << VARINT(0);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
-    return true;
-}
-
 UniValue pruneblockchain(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -962,28 +909,48 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless hash_type is muhash.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"    (string, optional, default=hash_serialized_2) Which UTXO set hash should be calculated. Options: 'hash_serialized_2' (scans the whole set), 'muhash' (kept up to date with every block)\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions (only with hash_serialized_2)\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size (only with hash_serialized_2)\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only with hash_serialized_2)\n"
+            "  \"muhash\": \"hash\",     (string) The rolling MuHash3072 hash of the set (only with muhash)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
     UniValue ret(UniValue::VOBJ);
 
+    std::string strHashType = request.params.size() > 0 ? request.params[0].get_str() : "hash_serialized_2";
+    if (strHashType == "muhash") {
+        LOCK(cs_main);
+        CUTXOSetHash hash;
+        if (!GetUTXOSetHash(hash))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "UTXO set hash is not available");
+        ret.pushKV("height", (int64_t)chainActive.Height());
+        ret.pushKV("bestblock", chainActive.Tip()->GetBlockHash().GetHex());
+        ret.pushKV("txouts", (int64_t)hash.nTransactionOutputs);
+        ret.pushKV("muhash", hash.GetHash().GetHex());
+        ret.pushKV("total_amount", ValueFromAmount(hash.nTotalAmount));
+        return ret;
+    }
+    if (strHashType != "hash_serialized_2")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", strHashType));
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsTip, stats)) {
@@ -992,7 +959,7 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bytes_serialized", (int64_t)stats.nSerializedSize);
-        ret.pushKV("hash_serialized", stats.hashSerialized.GetHex());
+        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
@@ -1000,6 +967,131 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue getcoinscacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getcoinscacheinfo\n"
+            "\nReturns details on the in-memory cache of the unspent transaction output set.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"size\": xxxxx,       (numeric) Number of cached outputs\n"
+            "  \"usage\": xxxxx,      (numeric) Memory usage of the cache\n"
+            "  \"flushing\": xxxxx,   (numeric) Memory usage of flushed outputs still being written to disk\n"
+            "  \"maxusage\": xxxxx,   (numeric) Memory usage the cache is flushed at (-dbcache), more if the mempool has room\n"
+            "  \"hits\": xxxxx,       (numeric) Lookups answered from the cache since startup\n"
+            "  \"misses\": xxxxx,     (numeric) Lookups that had to go to disk since startup\n"
+            "  \"hitrate\": x.xxx,    (numeric) Fraction of the lookups answered from the cache\n"
+            "  \"evictions\": xxxxx   (numeric) Outputs evicted from the cache to stay within its memory limit\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoinscacheinfo", "")
+            + HelpExampleRpc("getcoinscacheinfo", "")
+        );
+
+    LOCK(cs_main);
+    uint64_t nHits = pcoinsTip->GetCacheHits();
+    uint64_t nMisses = pcoinsTip->GetCacheMisses();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("size", (int64_t)pcoinsTip->GetCacheSize());
+    ret.pushKV("usage", (int64_t)pcoinsTip->DynamicMemoryUsage());
+    ret.pushKV("flushing", (int64_t)(pcoinsflusher ? pcoinsflusher->DynamicMemoryUsage() : 0));
+    ret.pushKV("maxusage", (int64_t)nCoinCacheUsage);
+    ret.pushKV("hits", (int64_t)nHits);
+    ret.pushKV("misses", (int64_t)nMisses);
+    ret.pushKV("hitrate", nHits + nMisses > 0 ? (double)nHits / (nHits + nMisses) : 0.0);
+    ret.pushKV("evictions", (int64_t)pcoinsTip->GetCacheEvictions());
+    return ret;
+}
+
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set of the chain tip to a snapshot file,\n"
+            "which loadtxoutset or -loadsnapshot can use to bootstrap another node.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) The snapshot file to write. A relative path is taken relative to the data directory\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,      (numeric) The number of unspent outputs written\n"
+            "  \"base_hash\": \"hash\",     (string) The hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,        (numeric) The height of that block\n"
+            "  \"path\": \"path\",          (string) The absolute path of the snapshot file\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash, as reported by gettxoutsetinfo\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CUTXOSnapshotMetadata metadata;
+    CCoinsStats stats;
+    if (!DumpUTXOSnapshot(path, metadata, stats))
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write UTXO snapshot");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_written", (int64_t)metadata.nCoins);
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    ret.pushKV("base_height", stats.nHeight);
+    ret.pushKV("path", path.string());
+    ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+    return ret;
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw runtime_error(
+            "loadtxoutset \"path\" \"hash\"\n"
+            "\nReplaces the unspent transaction output set with a snapshot written by dumptxoutset,\n"
+            "and makes the block it was taken at the chain tip. The headers up to that block must\n"
+            "already be known, and it must extend the current tip. Blocks below it are not downloaded,\n"
+            "so after a restart the node no longer offers to serve historical blocks.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) The snapshot file. A relative path is taken relative to the data directory\n"
+            "2. \"hash\"      (string, required) The expected hash_serialized_2 of the snapshot, from gettxoutsetinfo on a trusted node at the snapshot block\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_loaded\": n,       (numeric) The number of unspent outputs loaded\n"
+            "  \"base_hash\": \"hash\",     (string) The hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,        (numeric) The height of that block\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\" \"5ce1c5c3a9c7d1c1e4b5b2f0e3d64e2d3b3d7c4b8a6d1f2a9a3f0c1e5d7b9a48\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\", \"5ce1c5c3a9c7d1c1e4b5b2f0e3d64e2d3b3d7c4b8a6d1f2a9a3f0c1e5d7b9a48\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    uint256 hash = ParseHashV(request.params[1], "hash");
+
+    CValidationState state;
+    CUTXOSnapshotMetadata metadata;
+    if (!LoadUTXOSnapshot(state, Params(), path, hash, metadata))
+        throw JSONRPCError(RPC_MISC_ERROR, state.GetRejectReason());
+
+    // Connect any blocks that were already downloaded past the snapshot.
+    ActivateBestChain(state, Params());
+    if (!state.IsValid())
+        throw JSONRPCError(RPC_DATABASE_ERROR, state.GetRejectReason());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_loaded", (int64_t)metadata.nCoins);
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    {
+        LOCK(cs_main);
+        ret.pushKV("base_height", mapBlockIndex[metadata.hashBlock]->nHeight);
+    }
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1025,7 +1117,6 @@ UniValue gettxout(const JSONRPCRequest& request)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
             "}\n"
 
@@ -1049,33 +1140,34 @@ UniValue gettxout(const JSONRPCRequest& request)
     if (request.params.size() > 2)
         fMempool = request.params[2].get_bool();
 
-    CCoins coins;
+    COutPoint out(hash, n);
+
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) { // TODO: filtering spent coins should be done by the CCoinsViewMemPool
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        }
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin)) {
             return NullUniValue;
+        }
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT) {
         ret.pushKV("confirmations", 0);
-    else
-        ret.pushKV("confirmations", pindex->nHeight - coins.nHeight + 1);
-    ret.pushKV("value", ValueFromAmount(coins.vout[n].nValue));
+    } else {
+        ret.pushKV("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1));
+    }
+    ret.pushKV("value", ValueFromAmount(coin.out.nValue));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.pushKV("scriptPubKey", o);
-    ret.pushKV("version", coins.nVersion);
-    ret.pushKV("coinbase", coins.fCoinBase);
+    ret.pushKV("coinbase", (bool)coin.fCoinBase);
 
     return ret;
 }
@@ -1769,8 +1861,8 @@ static UniValue getblockstats(const JSONRPCRequest& request)
         if (loop_inputs) {
             CAmount tx_total_in = 0;
             const auto& txundo = blockUndo.vtxundo.at(i - 1);
-            for (const CTxInUndo& coin: txundo.vprevout) {
-                const CTxOut& prevoutput = coin.txout;
+            for (const Coin& coin: txundo.vprevout) {
+                const CTxOut& prevoutput = coin.out;
 
                 tx_total_in += prevoutput.nValue;
                 utxo_size_inc -= GetSerializeSize(prevoutput, SER_NETWORK, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
@@ -1872,7 +1964,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_type"} },
+    { "blockchain",         "getcoinscacheinfo",      &getcoinscacheinfo,      true,  {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           true,  {"path","hash"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
 
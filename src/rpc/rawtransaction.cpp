@@ -284,9 +284,10 @@ UniValue gettxoutproof(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         pblockindex = mapBlockIndex[hashBlock];
     } else {
-        CCoins coins;
-        if (pcoinsTip->GetCoins(oneTxid, coins) && coins.nHeight > 0 && coins.nHeight <= chainActive.Height())
-            pblockindex = chainActive[coins.nHeight];
+        const Coin& coin = AccessByTxid(*pcoinsTip, oneTxid);
+        if (!coin.IsSpent() && coin.nHeight > 0 && coin.nHeight <= chainActive.Height()) {
+            pblockindex = chainActive[coin.nHeight];
+        }
     }
 
     if (pblockindex == NULL)
@@ -693,9 +694,7 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
         view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
         BOOST_FOREACH(const CTxIn& txin, mergedTx.vin) {
-            const uint256& prevHash = txin.prevout.hash;
-            CCoins coins;
-            view.AccessCoins(prevHash); // this is certainly allowed to fail
+            view.AccessCoin(txin.prevout); // Load entries from viewChain into view; can fail.
         }
 
         view.SetBackend(viewDummy); // switch back to avoid locking mempool for too long
@@ -746,24 +745,26 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
             if (nOut < 0)
                 throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "vout must be positive");
 
+            COutPoint out(txid, nOut);
             vector<unsigned char> pkData(ParseHexO(prevOut, "scriptPubKey"));
             CScript scriptPubKey(pkData.begin(), pkData.end());
 
             {
-                CCoinsModifier coins = view.ModifyCoins(txid);
-                if (coins->IsAvailable(nOut) && coins->vout[nOut].scriptPubKey != scriptPubKey) {
+                const Coin& coin = view.AccessCoin(out);
+                if (!coin.IsSpent() && coin.out.scriptPubKey != scriptPubKey) {
                     string err("Previous output scriptPubKey mismatch:\n");
-                    err = err + ScriptToAsmStr(coins->vout[nOut].scriptPubKey) + "\nvs:\n"+
+                    err = err + ScriptToAsmStr(coin.out.scriptPubKey) + "\nvs:\n"+
                         ScriptToAsmStr(scriptPubKey);
                     throw JSONRPCError(RPC_DESERIALIZATION_ERROR, err);
                 }
-                if ((unsigned int)nOut >= coins->vout.size())
-                    coins->vout.resize(nOut+1);
-                coins->vout[nOut].scriptPubKey = scriptPubKey;
-                coins->vout[nOut].nValue = 0;
+                Coin newcoin;
+                newcoin.out.scriptPubKey = scriptPubKey;
+                newcoin.out.nValue = 0;
                 if (prevOut.exists("amount")) {
-                    coins->vout[nOut].nValue = AmountFromValue(find_value(prevOut, "amount"));
+                    newcoin.out.nValue = AmountFromValue(find_value(prevOut, "amount"));
                 }
+                newcoin.nHeight = 1;
+                view.AddCoin(out, std::move(newcoin), true);
             }
 
             // if redeemScript given and not using the local wallet (private keys
@@ -821,13 +822,13 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
     // Sign what we can:
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
         CTxIn& txin = mergedTx.vin[i];
-        const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-        if (coins == NULL || !coins->IsAvailable(txin.prevout.n)) {
+        const Coin& coin = view.AccessCoin(txin.prevout);
+        if (coin.IsSpent()) {
             TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
             continue;
         }
-        const CScript& prevPubKey = coins->vout[txin.prevout.n].scriptPubKey;
-        const CAmount& amount = coins->vout[txin.prevout.n].nValue;
+        const CScript& prevPubKey = coin.out.scriptPubKey;
+        const CAmount& amount = coin.out.nValue;
 
         SignatureData sigdata;
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
@@ -883,7 +884,6 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
             + HelpExampleRpc("sendrawtransaction", "\"signedhex\"")
         );
 
-    LOCK(cs_main);
     RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VSTR)(UniValue::VBOOL));
 
     // parse hex string from parameter
@@ -898,15 +898,23 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     if (request.params.size() > 1 && request.params[1].get_bool())
         nMaxRawTxFee = 0;
 
-    CCoinsViewCache &view = *pcoinsTip;
-    const CCoins* existingCoins = view.AccessCoins(hashTx);
-    bool fHaveMempool = mempool.exists(hashTx);
-    bool fHaveChain = existingCoins && existingCoins->nHeight < 1000000000;
+    bool fHaveChain = false;
+    bool fHaveMempool;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
+            const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+            fHaveChain = !existingCoin.IsSpent();
+        }
+        fHaveMempool = mempool.exists(hashTx);
+    }
     if (!fHaveMempool && !fHaveChain) {
         // push to local node and sync with wallets
+        // (the scripts are checked without holding cs_main)
         CValidationState state;
         bool fMissingInputs;
-        if (!AcceptToMemoryPool(mempool, state, std::move(tx), fLimitFree, &fMissingInputs, NULL, false, nMaxRawTxFee)) {
+        if (!AcceptToMemoryPoolUnlocked(mempool, state, std::move(tx), fLimitFree, &fMissingInputs, NULL, false, nMaxRawTxFee)) {
             if (state.IsInvalid()) {
                 throw JSONRPCError(RPC_TRANSACTION_REJECTED, strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason()));
             } else {
@@ -930,6 +938,129 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+/**
+ * Submit a batch of transactions to the mempool, and relay those which are
+ * in it afterwards. Returns the outcome for each transaction. Shared with
+ * the REST interface.
+ */
+UniValue SendRawTransactions(const std::vector<CTransactionRef>& vtx, CAmount nMaxRawTxFee)
+{
+    std::vector<std::string> vError(vtx.size());
+    std::vector<size_t> vFirst(vtx.size());
+    std::vector<CTransactionRef> vSubmit;
+    std::vector<size_t> vSubmitIndex;
+    {
+        // Transactions already known are not submitted again
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        std::map<uint256, size_t> mapSeen;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const uint256& hashTx = vtx[i]->GetHash();
+            vFirst[i] = mapSeen.insert(std::make_pair(hashTx, i)).first->second;
+            if (vFirst[i] != i)
+                continue;
+            bool fHaveChain = false;
+            for (size_t o = 0; !fHaveChain && o < vtx[i]->vout.size(); o++) {
+                const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+                fHaveChain = !existingCoin.IsSpent();
+            }
+            if (fHaveChain) {
+                vError[i] = "transaction already in block chain";
+            } else if (!mempool.exists(hashTx)) {
+                vSubmit.push_back(vtx[i]);
+                vSubmitIndex.push_back(i);
+            }
+        }
+    }
+
+    // push to local node and sync with wallets
+    std::vector<CValidationState> vState;
+    std::vector<bool> vMissingInputs;
+    const bool fLimitFree = false;
+    std::vector<bool> vAccepted = AcceptToMemoryPoolBatch(mempool, vSubmit, vState, vMissingInputs, fLimitFree, nMaxRawTxFee);
+    for (size_t k = 0; k < vSubmit.size(); k++) {
+        if (vAccepted[k])
+            continue;
+        const CValidationState& state = vState[k];
+        if (state.IsInvalid())
+            vError[vSubmitIndex[k]] = strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason());
+        else if (vMissingInputs[k])
+            vError[vSubmitIndex[k]] = "Missing inputs";
+        else
+            vError[vSubmitIndex[k]] = state.GetRejectReason();
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        const std::string& strError = vError[vFirst[i]];
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", vtx[i]->GetHash().GetHex());
+        entry.pushKV("accepted", strError.empty());
+        if (!strError.empty())
+            entry.pushKV("error", strError);
+        result.push_back(entry);
+
+        if (strError.empty() && vFirst[i] == i && g_connman) {
+            CInv inv(MSG_TX, vtx[i]->GetHash());
+            g_connman->ForEachNode([&inv](CNode* pnode)
+            {
+                pnode->PushInventory(inv);
+            });
+        }
+    }
+    return result;
+}
+
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits several raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The transactions may spend each other's outputs, in any order: parents are accepted\n"
+            "before their children, and the scripts of transactions not depending on each other\n"
+            "are checked in parallel.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"    (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array) One entry per transaction, in the order given\n"
+            "  {\n"
+            "    \"txid\" : \"hex\",     (string) The transaction hash in hex\n"
+            "    \"accepted\" : true|false, (boolean) Whether the transaction is in the mempool and was relayed\n"
+            "    \"error\" : \"msg\"     (string, optional) Why the transaction was not accepted, as sendrawtransaction would report it\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex2\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex2\"]")
+        );
+
+    RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+
+    // parse all hex strings before submitting any of them
+    const UniValue& hexstrings = request.params[0].get_array();
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(hexstrings.size());
+    for (size_t i = 0; i < hexstrings.size(); i++) {
+        CMutableTransaction mtx;
+        if (!hexstrings[i].isStr() || !DecodeHexTx(mtx, hexstrings[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed (index %u)", i));
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (request.params.size() > 1 && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    return SendRawTransactions(vtx, nMaxRawTxFee);
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -938,6 +1069,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  {"hexstring"} },
     { "rawtransactions",    "decodescript",           &decodescript,           true,  {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    false, {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  {"txids", "blockhash"} },
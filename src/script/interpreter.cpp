@@ -11,6 +11,7 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 using namespace std;
@@ -1142,6 +1143,43 @@ public:
     }
 };
 
+/** Size of an input serialized with an empty script, as it appears in legacy signature hashes */
+static const size_t LEGACY_BLANK_INPUT_SIZE = 41;
+
+/** Stream hashing everything written to it with double SHA256, which can be resumed from a saved state */
+class CSHA256Writer
+{
+private:
+    CSHA256 ctx;
+
+public:
+    CSHA256Writer() {}
+    explicit CSHA256Writer(const CSHA256& ctxIn) : ctx(ctxIn) {}
+
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return 0; }
+
+    void write(const char *pch, size_t size) {
+        ctx.Write((const unsigned char*)pch, size);
+    }
+
+    template<typename T>
+    CSHA256Writer& operator<<(const T& obj) {
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+
+    const CSHA256& GetState() const { return ctx; }
+
+    uint256 GetHash() {
+        unsigned char buf[CSHA256::OUTPUT_SIZE];
+        ctx.Finalize(buf);
+        uint256 result;
+        CSHA256().Write(buf, sizeof(buf)).Finalize(result.begin());
+        return result;
+    }
+};
+
 uint256 GetPrevoutHash(const CTransaction& txTo) {
     CHashWriter ss(SER_GETHASH, 0);
     for (unsigned int n = 0; n < txTo.vin.size(); n++) {
@@ -1173,6 +1211,28 @@ PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
     hashPrevouts = GetPrevoutHash(txTo);
     hashSequence = GetSequenceHash(txTo);
     hashOutputs = GetOutputsHash(txTo);
+
+    fLegacyCached = txTo.vin.size() > 1;
+    if (fLegacyCached) {
+        CVectorWriter inputs(SER_GETHASH, 0, vchLegacyInputs, 0);
+        CVectorWriter inputsNoSequence(SER_GETHASH, 0, vchLegacyInputsNoSequence, 0);
+        CSHA256Writer prefix;
+        prefix << txTo.nVersion;
+        ::WriteCompactSize(prefix, txTo.vin.size());
+        vchLegacyInputs.reserve(txTo.vin.size() * LEGACY_BLANK_INPUT_SIZE);
+        vchLegacyInputsNoSequence.reserve(txTo.vin.size() * LEGACY_BLANK_INPUT_SIZE);
+        vLegacyMidstates.reserve(txTo.vin.size());
+        for (const CTxIn& txin : txTo.vin) {
+            vLegacyMidstates.push_back(prefix.GetState());
+            size_t nPos = vchLegacyInputs.size();
+            inputs << txin.prevout << CScriptBase() << txin.nSequence;
+            inputsNoSequence << txin.prevout << CScriptBase() << (int)0;
+            prefix.write((const char*)&vchLegacyInputs[nPos], vchLegacyInputs.size() - nPos);
+        }
+        assert(vchLegacyInputs.size() == txTo.vin.size() * LEGACY_BLANK_INPUT_SIZE);
+        CVectorWriter outputs(SER_GETHASH, 0, vchLegacyOutputs, 0);
+        outputs << txTo.vout;
+    }
 }
 
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
@@ -1239,6 +1299,39 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // Only the input being signed changes between the inputs, so start from the
+    // state after the inputs before it and append the cached remainder. This
+    // hashes exactly the same data as serializing txTmp below.
+    if (cache && cache->fLegacyCached && !(nHashType & SIGHASH_ANYONECANPAY)) {
+        const bool fHashSingle = (nHashType & 0x1f) == SIGHASH_SINGLE;
+        const bool fHashNone = (nHashType & 0x1f) == SIGHASH_NONE;
+        const std::vector<unsigned char>& vchInputs = (fHashSingle || fHashNone) ? cache->vchLegacyInputsNoSequence : cache->vchLegacyInputs;
+        const size_t nBefore = nIn * LEGACY_BLANK_INPUT_SIZE;
+        const size_t nAfter = (nIn + 1) * LEGACY_BLANK_INPUT_SIZE;
+
+        CSHA256Writer ss;
+        if (fHashSingle || fHashNone) {
+            ss << txTo.nVersion;
+            ::WriteCompactSize(ss, txTo.vin.size());
+            ss.write((const char*)vchInputs.data(), nBefore);
+        } else {
+            ss = CSHA256Writer(cache->vLegacyMidstates[nIn]);
+        }
+        txTmp.SerializeInput(ss, nIn);
+        ss.write((const char*)vchInputs.data() + nAfter, vchInputs.size() - nAfter);
+        if (fHashNone) {
+            ::WriteCompactSize(ss, 0);
+        } else if (fHashSingle) {
+            ::WriteCompactSize(ss, nIn + 1);
+            for (unsigned int nOutput = 0; nOutput <= nIn; nOutput++)
+                txTmp.SerializeOutput(ss, nOutput);
+        } else {
+            ss.write((const char*)cache->vchLegacyOutputs.data(), cache->vchLegacyOutputs.size());
+        }
+        ss << txTo.nLockTime << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -8,6 +8,7 @@
 
 #include "script_error.h"
 #include "primitives/transaction.h"
+#include "crypto/sha256.h"
 
 #include <vector>
 #include <stdint.h>
@@ -114,6 +115,22 @@ struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
 
+    /**
+     * Parts of the legacy signature hash serialization that do not depend on
+     * the input being signed, so hashing many inputs of one transaction does
+     * not serialize all of it again for each of them. Only filled in for
+     * transactions with more than one input.
+     */
+    bool fLegacyCached;
+    //! All inputs with empty scripts, as serialized for SIGHASH_ALL
+    std::vector<unsigned char> vchLegacyInputs;
+    //! All inputs with empty scripts and zero sequences, as serialized for SIGHASH_NONE and SIGHASH_SINGLE
+    std::vector<unsigned char> vchLegacyInputsNoSequence;
+    //! All outputs, as serialized for SIGHASH_ALL
+    std::vector<unsigned char> vchLegacyOutputs;
+    //! SHA256 states after the version, the input count and the first n inputs of vchLegacyInputs
+    std::vector<CSHA256> vLegacyMidstates;
+
     PrecomputedTransactionData(const CTransaction& tx);
 };
 
@@ -6,8 +6,10 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "pubkey.h"
 #include "script/interpreter.h"
 
+#include <cstring>
 #include <vector>
 
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
@@ -17,11 +19,30 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
-class CPubKey;
+/**
+ * We're hashing a nonce into the entries themselves, so we don't need extra
+ * blinding in the set hash computation.
+ *
+ * This may exhibit platform endian dependent behavior but because these are
+ * nonced hashes (random) and this state is only ever used locally it is safe.
+ * All that matters is local consistency.
+ */
+class SignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select <8, "SignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin()+4*hash_select, 4);
+        return u;
+    }
+};
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
-private:
+protected:
     bool store;
 
 public:
@@ -30,6 +51,40 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** A signature check recorded by DeferringTransactionSignatureChecker */
+struct CDeferredSigCheck
+{
+    CPubKey pubkey;
+    std::vector<unsigned char> vchSig;
+    uint256 sighash;
+    //! Outcome, once the check has been verified
+    bool fValid;
+
+    CDeferredSigCheck(const CPubKey& pubkeyIn, const std::vector<unsigned char>& vchSigIn, const uint256& sighashIn) :
+        pubkey(pubkeyIn), vchSig(vchSigIn), sighash(sighashIn), fValid(false) {}
+};
+
+/**
+ * Signature checker that records the signatures it is asked to verify and
+ * reports them as valid, so they can be verified later in bulk. A script that
+ * passes this way is valid if all its recorded signatures are. Otherwise it has
+ * to be run again with a verifying checker, as the script may rely on some
+ * signature being invalid. Signatures in the signature cache are not recorded.
+ */
+class DeferringTransactionSignatureChecker : public CachingTransactionSignatureChecker
+{
+private:
+    std::vector<CDeferredSigCheck>& vDeferred;
+
+public:
+    DeferringTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, bool storeIn, PrecomputedTransactionData& txdataIn, std::vector<CDeferredSigCheck>& vDeferredIn) : CachingTransactionSignatureChecker(txToIn, nInIn, amount, storeIn, txdataIn), vDeferred(vDeferredIn) {}
+
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+};
+
 void InitSignatureCache();
 
+/** Add a signature that was verified outside of a CachingTransactionSignatureChecker to the cache */
+void AddSignatureCacheEntry(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,225 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include "memusage.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Memory resource for node-based containers, which allocate many objects of
+ * the same few sizes one at a time.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE_BYTES are carved out of larger chunks
+ * instead of being allocated individually, which saves the per-allocation
+ * overhead of malloc and keeps the nodes together. Freed blocks are kept in
+ * a free list per size and reused for the next allocation of that size;
+ * chunks are only released when the resource is destroyed. Larger or more
+ * strictly aligned allocations are passed on to operator new.
+ *
+ * Not thread-safe: a resource must only be used by one container, which
+ * PoolAllocator takes care of.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES>
+class PoolResource
+{
+public:
+    //! Alignment of the blocks, and granularity of their sizes
+    static const std::size_t ALIGN_BYTES = sizeof(void*);
+    //! Size of the first chunk; each next one is twice as large, up to MAX_CHUNK_SIZE_BYTES
+    static const std::size_t MIN_CHUNK_SIZE_BYTES = 16 * 1024;
+    static const std::size_t MAX_CHUNK_SIZE_BYTES = 256 * 1024;
+
+private:
+    struct ListNode {
+        ListNode* next;
+    };
+
+    //! Free blocks, by size in units of ALIGN_BYTES
+    std::vector<ListNode*> vFreeLists;
+    std::vector<void*> vChunks;
+    char* pChunkNext;
+    char* pChunkEnd;
+    std::size_t nNextChunkSize;
+
+    //! Bytes of the blocks in use
+    std::size_t nPoolUsage;
+    //! Memory used by the allocations too large for the pool
+    std::size_t nLargeUsage;
+
+    static std::size_t RoundUp(std::size_t bytes)
+    {
+        return (std::max<std::size_t>(bytes, 1) + ALIGN_BYTES - 1) & ~(ALIGN_BYTES - 1);
+    }
+
+    static bool IsPooled(std::size_t bytes, std::size_t alignment)
+    {
+        return bytes <= MAX_BLOCK_SIZE_BYTES && alignment <= ALIGN_BYTES;
+    }
+
+    void PushFree(void* p, std::size_t bytes)
+    {
+        ListNode* node = static_cast<ListNode*>(p);
+        node->next = vFreeLists[bytes / ALIGN_BYTES];
+        vFreeLists[bytes / ALIGN_BYTES] = node;
+    }
+
+    void AllocateChunk()
+    {
+        // Keep what is left of the current chunk for blocks of that size.
+        if (pChunkEnd != pChunkNext)
+            PushFree(pChunkNext, pChunkEnd - pChunkNext);
+        vChunks.push_back(::operator new(nNextChunkSize));
+        pChunkNext = static_cast<char*>(vChunks.back());
+        pChunkEnd = pChunkNext + nNextChunkSize;
+        if (nNextChunkSize < MAX_CHUNK_SIZE_BYTES)
+            nNextChunkSize *= 2;
+    }
+
+public:
+    PoolResource() : vFreeLists(RoundUp(MAX_BLOCK_SIZE_BYTES) / ALIGN_BYTES + 1), pChunkNext(NULL), pChunkEnd(NULL), nNextChunkSize(MIN_CHUNK_SIZE_BYTES), nPoolUsage(0), nLargeUsage(0) {}
+
+    ~PoolResource()
+    {
+        for (void* chunk : vChunks)
+            ::operator delete(chunk);
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsPooled(bytes, alignment)) {
+            nLargeUsage += memusage::MallocUsage(bytes);
+            return ::operator new(bytes);
+        }
+        bytes = RoundUp(bytes);
+        nPoolUsage += bytes;
+        ListNode*& free = vFreeLists[bytes / ALIGN_BYTES];
+        if (free != NULL) {
+            ListNode* node = free;
+            free = node->next;
+            return node;
+        }
+        if ((std::size_t)(pChunkEnd - pChunkNext) < bytes)
+            AllocateChunk();
+        void* p = pChunkNext;
+        pChunkNext += bytes;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsPooled(bytes, alignment)) {
+            nLargeUsage -= memusage::MallocUsage(bytes);
+            ::operator delete(p);
+            return;
+        }
+        bytes = RoundUp(bytes);
+        nPoolUsage -= bytes;
+        PushFree(p, bytes);
+    }
+
+    /**
+     * Memory used by the allocations that were not freed yet. Freed blocks
+     * are not counted: like memory returned to malloc, they are reused by
+     * the next allocations.
+     */
+    std::size_t DynamicMemoryUsage() const
+    {
+        return nPoolUsage + nLargeUsage;
+    }
+
+    //! Memory held in chunks, whether in use or not
+    std::size_t ChunkUsage() const
+    {
+        std::size_t nUsage = 0;
+        std::size_t nChunkSize = MIN_CHUNK_SIZE_BYTES;
+        for (std::size_t i = 0; i < vChunks.size(); i++) {
+            nUsage += memusage::MallocUsage(nChunkSize);
+            if (nChunkSize < MAX_CHUNK_SIZE_BYTES)
+                nChunkSize *= 2;
+        }
+        return nUsage;
+    }
+};
+
+/**
+ * Allocator drawing from a PoolResource, for the nodes of node-based
+ * containers such as boost::unordered_map and boost::multi_index_container.
+ *
+ * A default-constructed allocator creates its own resource, which is shared
+ * with the copies (and rebound copies) the container makes internally. So
+ * every container gets a resource of its own, whose memory usage is that of
+ * the container, and which it hands over when swapped or move-assigned.
+ */
+template <typename T, std::size_t MAX_BLOCK_SIZE_BYTES>
+class PoolAllocator
+{
+    template <typename U, std::size_t N>
+    friend class PoolAllocator;
+
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES> Resource;
+    std::shared_ptr<Resource> resource;
+
+public:
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES> other;
+    };
+
+    PoolAllocator() : resource(std::make_shared<Resource>()) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES>& other) : resource(other.resource) {}
+
+    //! A copy of a container gets a resource of its own.
+    PoolAllocator select_on_container_copy_construction() const
+    {
+        return PoolAllocator();
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    //! Memory used by the container owning this allocator
+    std::size_t DynamicMemoryUsage() const
+    {
+        return resource->DynamicMemoryUsage();
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES>& other) const
+    {
+        return resource == other.resource;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES>& other) const
+    {
+        return resource != other.resource;
+    }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -0,0 +1,173 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "templatebroadcast.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "miner.h"
+#include "rpc/server.h"
+#include "scheduler.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/bind.hpp>
+
+#include <univalue.h>
+
+std::unique_ptr<CTemplateBroadcaster> g_templatebroadcaster;
+
+CTemplateBroadcaster::CTemplateBroadcaster(CScheduler* schedulerIn, bool fActiveIn, int64_t nRefreshIntervalIn)
+    : scheduler(schedulerIn), nRefreshInterval(nRefreshIntervalIn), fActive(fActiveIn), fInterrupted(false)
+{
+}
+
+void CTemplateBroadcaster::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload)
+        return;
+    if (scheduler)
+        scheduler->scheduleFromNow(boost::bind(&CTemplateBroadcaster::Refresh, this), 0);
+    else
+        Refresh();
+}
+
+void CTemplateBroadcaster::Refresh()
+{
+    LOCK(cs_refresh);
+    std::shared_ptr<const CSharedBlockTemplate> pcurrent;
+    {
+        LOCK(cs);
+        if (!fActive || fInterrupted)
+            return;
+        pcurrent = ptemplate;
+    }
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    std::shared_ptr<CSharedBlockTemplate> pnew = std::make_shared<CSharedBlockTemplate>();
+    {
+        LOCK(cs_main);
+        if (IsInitialBlockDownload())
+            return;
+        const CBlockIndex* pindexPrev = chainActive.Tip();
+        pnew->nTransactionsUpdated = mempool.GetTransactionsUpdated();
+        pnew->nTime = GetTime();
+        if (pcurrent && pcurrent->block->hashPrevBlock == pindexPrev->GetBlockHash() &&
+            (pcurrent->nTransactionsUpdated == pnew->nTransactionsUpdated || pnew->nTime - pcurrent->nTime < nRefreshInterval))
+            return;
+
+        try {
+            pblocktemplate = CreateIncrementalBlock(Params(), CScript() << OP_TRUE, false);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            return;
+        }
+        pnew->nHeight = pindexPrev->nHeight + 1;
+    }
+
+    CBlock& block = pblocktemplate->block;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    pnew->block = std::make_shared<const CBlock>(block);
+    pnew->hash = block.GetHash();
+    pnew->nFees = -pblocktemplate->vTxFees[0];
+
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    ssBlock << block;
+    pnew->strBinary = ssBlock.str();
+    pnew->strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("hash", pnew->hash.GetHex());
+    result.pushKV("previousblockhash", block.hashPrevBlock.GetHex());
+    result.pushKV("height", pnew->nHeight);
+    result.pushKV("version", block.nVersion);
+    result.pushKV("curtime", block.GetBlockTime());
+    result.pushKV("bits", strprintf("%08x", block.nBits));
+    result.pushKV("target", arith_uint256().SetCompact(block.nBits).GetHex());
+    result.pushKV("coinbasevalue", block.vtx[0]->vout[0].nValue);
+    result.pushKV("fees", pnew->nFees);
+    result.pushKV("size", (int64_t)pnew->strBinary.size());
+    result.pushKV("ntx", (int64_t)block.vtx.size());
+    result.pushKV("data", HexStr(ssBlock.begin(), ssBlock.end()));
+    pnew->strJSON = result.write() + "\n";
+
+    std::vector<Callback> vCallbacks;
+    {
+        LOCK(cs);
+        ptemplate = pnew;
+        std::vector<std::pair<uint256, Callback> > vStillWaiting;
+        for (size_t i = 0; i < vWaiters.size(); i++) {
+            if (vWaiters[i].first != pnew->hash)
+                vCallbacks.push_back(vWaiters[i].second);
+            else
+                vStillWaiting.push_back(vWaiters[i]);
+        }
+        vWaiters.swap(vStillWaiting);
+    }
+
+    LogPrint("rpc", "%s: new template %s at height %d (%u txs), %u waiters\n", __func__,
+             pnew->hash.ToString(), pnew->nHeight, block.vtx.size(), vCallbacks.size());
+    for (size_t i = 0; i < vCallbacks.size(); i++)
+        vCallbacks[i](pnew);
+    {
+        // Other validation interface signals are sent with cs_main held,
+        // and listeners such as ZMQ rely on not being called concurrently
+        LOCK(cs_main);
+        GetMainSignals().NewBlockTemplate(pnew->block);
+    }
+}
+
+std::shared_ptr<const CSharedBlockTemplate> CTemplateBroadcaster::Get()
+{
+    {
+        LOCK(cs);
+        fActive = true;
+        if (ptemplate)
+            return ptemplate;
+    }
+    Refresh();
+    LOCK(cs);
+    return ptemplate;
+}
+
+void CTemplateBroadcaster::Wait(const uint256& hashKnown, const Callback& callback)
+{
+    std::shared_ptr<const CSharedBlockTemplate> pcurrent;
+    {
+        LOCK(cs);
+        fActive = true;
+        if (!fInterrupted) {
+            if (!ptemplate || ptemplate->hash == hashKnown) {
+                vWaiters.push_back(std::make_pair(hashKnown, callback));
+                return;
+            }
+            pcurrent = ptemplate;
+        }
+    }
+    callback(pcurrent);
+}
+
+void CTemplateBroadcaster::Interrupt()
+{
+    std::vector<std::pair<uint256, Callback> > vReleased;
+    {
+        LOCK(cs);
+        fInterrupted = true;
+        vReleased.swap(vWaiters);
+    }
+    for (size_t i = 0; i < vReleased.size(); i++)
+        vReleased[i].second(std::shared_ptr<const CSharedBlockTemplate>());
+}
+
+size_t CTemplateBroadcaster::GetWaiterCount()
+{
+    LOCK(cs);
+    return vWaiters.size();
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TEMPLATEBROADCAST_H
+#define BITCOIN_TEMPLATEBROADCAST_H
+
+#include "amount.h"
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class CScheduler;
+
+/** Seconds between checks whether the mempool warrants a new shared template */
+static const int64_t TEMPLATE_CHECK_INTERVAL = 10;
+/** Minimum age in seconds of a shared template before mempool changes replace it */
+static const int64_t DEFAULT_TEMPLATE_REFRESH_INTERVAL = 60;
+
+/**
+ * A block template shared by everyone waiting for new work, serialized once.
+ * The block pays its coinbase to OP_TRUE, like getblocktemplate's, and has
+ * its merkle root set, so its hash identifies the template.
+ */
+struct CSharedBlockTemplate
+{
+    std::shared_ptr<const CBlock> block;
+    uint256 hash;
+    int nHeight;
+    CAmount nFees;
+    // Mempool update counter and time the template was created at
+    unsigned int nTransactionsUpdated;
+    int64_t nTime;
+
+    // The block as served over REST: binary, hex and JSON
+    std::string strBinary;
+    std::string strHex;
+    std::string strJSON;
+};
+
+/**
+ * Keeps one shared block template up to date and hands it to whoever waits
+ * for a new one.
+ *
+ * A new template is made when the tip changes, and when the mempool changed
+ * and the current template is at least nRefreshInterval seconds old. The
+ * work happens on the scheduler thread, once per template however many
+ * waiters there are: waiters register a callback instead of blocking a
+ * thread, and NewBlockTemplate is signalled to the validation interfaces
+ * (for ZMQ).
+ */
+class CTemplateBroadcaster : public CValidationInterface
+{
+public:
+    typedef std::function<void (const std::shared_ptr<const CSharedBlockTemplate>&)> Callback;
+
+private:
+    CScheduler* scheduler;
+    const int64_t nRefreshInterval;
+
+    // Serializes Refresh, taken before cs_main
+    CCriticalSection cs_refresh;
+    // Guards the members below
+    CCriticalSection cs;
+    // Whether templates are wanted yet: set by the first Get or Wait
+    bool fActive;
+    bool fInterrupted;
+    std::shared_ptr<const CSharedBlockTemplate> ptemplate;
+    std::vector<std::pair<uint256, Callback> > vWaiters;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+
+public:
+    /** With a null scheduler, tip changes refresh the template on the notifying thread. */
+    CTemplateBroadcaster(CScheduler* schedulerIn, bool fActiveIn, int64_t nRefreshIntervalIn = DEFAULT_TEMPLATE_REFRESH_INTERVAL);
+
+    /** Make a new shared template if the tip or (for long enough) the mempool changed. */
+    void Refresh();
+
+    /** Return the current shared template, making one if there is none; null during initial block download. */
+    std::shared_ptr<const CSharedBlockTemplate> Get();
+
+    /**
+     * Call callback with the first template whose hash is not hashKnown:
+     * right away if the current one qualifies, otherwise from Refresh.
+     * After Interrupt, callback is called with null.
+     */
+    void Wait(const uint256& hashKnown, const Callback& callback);
+
+    /** Release all waiters (with a null template) and refuse new ones. */
+    void Interrupt();
+
+    size_t GetWaiterCount();
+};
+
+extern std::unique_ptr<CTemplateBroadcaster> g_templatebroadcaster;
+
+#endif // BITCOIN_TEMPLATEBROADCAST_H
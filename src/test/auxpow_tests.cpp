@@ -9,6 +9,7 @@
 #include "dogecoin.h"
 #include "primitives/block.h"
 #include "script/script.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
 #include "validation.h"
@@ -452,4 +453,111 @@ BOOST_AUTO_TEST_CASE(auxpow_pow)
 
 /* ************************************************************************** */
 
+BOOST_AUTO_TEST_CASE(auxpow_pow_header_check)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = Params().GetConsensus(0);
+
+    const arith_uint256 target = (~arith_uint256(0) >> 1);
+    std::vector<CBlockHeader> headers;
+
+    /* Alternate between valid and invalid PoW so that groups hashed
+     through the multi-lane scrypt kernel mix both outcomes.  */
+    for (int i = 0; i < 11; ++i) {
+        CBlockHeader block;
+        block.nVersion = 1;
+        block.nTime = i;
+        block.nBits = target.GetCompact();
+        mineBlock(block, i % 3 != 1);
+        headers.push_back(block);
+    }
+
+    /* A merge-mined header whose parent block carries the work.  */
+    CBlockHeader block;
+    block.nBits = target.GetCompact();
+    block.SetBaseVersion(2, params.nAuxpowChainId);
+    block.SetAuxpowFlag(true);
+    CAuxpowBuilder builder(5, 42);
+    const int index = CAuxPow::getExpectedIndex(7, params.nAuxpowChainId, 3);
+    const std::vector<unsigned char> auxRoot = builder.buildAuxpowChain(block.GetHash(), 3, index);
+    builder.setCoinbase(CScript() << CAuxpowBuilder::buildCoinbaseData(true, auxRoot, 3, 7));
+    mineBlock(builder.parentBlock, true, block.nBits);
+    block.SetAuxpow(new CAuxPow(builder.get()));
+    headers.push_back(block);
+    mineBlock(builder.parentBlock, false, block.nBits);
+    block.SetAuxpow(new CAuxPow(builder.get()));
+    headers.push_back(block);
+
+    std::unique_ptr<bool[]> fValid(new bool[headers.size()]());
+    for (size_t i = 0; i < headers.size(); i += 4) {
+        std::vector<const CBlockHeader*> vGroup;
+        std::vector<bool*> vfValid;
+        for (size_t j = i; j < std::min(i + 4, headers.size()); ++j) {
+            vGroup.push_back(&headers[j]);
+            vfValid.push_back(&fValid[j]);
+        }
+        CHeaderPoWCheck check(vGroup, vfValid);
+        BOOST_CHECK(check());
+    }
+    for (size_t i = 0; i < headers.size(); ++i)
+        BOOST_CHECK_EQUAL(fValid[i], CheckAuxPowProofOfWork(headers[i], params));
+    BOOST_CHECK(fValid[headers.size() - 2]);
+    BOOST_CHECK(!fValid[headers.size() - 1]);
+}
+
+/* ************************************************************************** */
+
+BOOST_AUTO_TEST_CASE(auxpow_pow_cache)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = Params().GetConsensus(0);
+    CValidationState state;
+
+    CPoWCacheDB powcache(1 << 20, true);
+    ppowcache = &powcache;
+
+    const arith_uint256 target = (~arith_uint256(0) >> 1);
+    CBlockHeader block;
+    block.nVersion = 1;
+    block.nBits = target.GetCompact();
+
+    /* A checked header has its scrypt hash remembered.  */
+    mineBlock(block, true);
+    uint256 hashPoW;
+    BOOST_CHECK(!powcache.ReadPoWHash(block.GetHash(), hashPoW));
+    BOOST_CHECK(CheckBlockHeader(block, state));
+    BOOST_CHECK(powcache.ReadPoWHash(block.GetHash(), hashPoW));
+    BOOST_CHECK(hashPoW == block.GetPoWHash());
+
+    /* Failed checks are not remembered.  */
+    mineBlock(block, false);
+    BOOST_CHECK(!CheckBlockHeader(block, state));
+    BOOST_CHECK(!powcache.ReadPoWHash(block.GetHash(), hashPoW));
+
+    /* A cached hash is used instead of running scrypt again.  */
+    std::vector<std::pair<uint256, uint256> > vPoWHashes;
+    vPoWHashes.push_back(std::make_pair(block.GetHash(), uint256()));
+    BOOST_CHECK(powcache.WritePoWHashes(vPoWHashes));
+    BOOST_CHECK(CheckBlockHeader(block, state));
+
+    /* Merge-mined blocks are cached under their parent block.  */
+    CBlockHeader auxBlock;
+    auxBlock.nBits = target.GetCompact();
+    auxBlock.SetBaseVersion(2, params.nAuxpowChainId);
+    auxBlock.SetAuxpowFlag(true);
+    CAuxpowBuilder builder(5, 42);
+    const int index = CAuxPow::getExpectedIndex(7, params.nAuxpowChainId, 3);
+    const std::vector<unsigned char> auxRoot = builder.buildAuxpowChain(auxBlock.GetHash(), 3, index);
+    builder.setCoinbase(CScript() << CAuxpowBuilder::buildCoinbaseData(true, auxRoot, 3, 7));
+    mineBlock(builder.parentBlock, true, auxBlock.nBits);
+    auxBlock.SetAuxpow(new CAuxPow(builder.get()));
+    BOOST_CHECK(CheckBlockHeader(auxBlock, state));
+    BOOST_CHECK(powcache.ReadPoWHash(builder.parentBlock.GetHash(), hashPoW));
+    BOOST_CHECK(hashPoW == builder.parentBlock.GetPoWHash());
+
+    ppowcache = NULL;
+}
+
+/* ************************************************************************** */
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexfile.h"
+#include "chainparams.h"
+#include "txdb.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindexfile_tests, TestChain240Setup)
+
+BOOST_AUTO_TEST_CASE(blockindexfile_roundtrip)
+{
+    LOCK(cs_main);
+    const fs::path path = GetDataDir() / "index_test.dat";
+    BOOST_CHECK(WriteBlockIndexFile(path, mapBlockIndex, 42));
+
+    BlockMap mapLoaded;
+    CBlockIndexArena arena;
+    BOOST_CHECK(!LoadBlockIndexFile(path, 43, mapLoaded, arena));
+    BOOST_CHECK(mapLoaded.empty());
+    BOOST_CHECK(LoadBlockIndexFile(path, 42, mapLoaded, arena));
+    BOOST_CHECK_EQUAL(mapLoaded.size(), mapBlockIndex.size());
+    BOOST_CHECK_EQUAL(arena.size(), mapBlockIndex.size());
+
+    for (BlockMap::const_iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        const CBlockIndex* pindex = it->second;
+        BlockMap::const_iterator mi = mapLoaded.find(it->first);
+        BOOST_REQUIRE(mi != mapLoaded.end());
+        const CBlockIndex* pindexLoaded = mi->second;
+        BOOST_CHECK(arena.Contains(pindexLoaded));
+        BOOST_CHECK(pindexLoaded->GetBlockHash() == pindex->GetBlockHash());
+        // The header fields and the parent hash the block's hash
+        BOOST_CHECK(CDiskBlockIndex(pindexLoaded).GetBlockHash() == pindex->GetBlockHash());
+        BOOST_CHECK_EQUAL(pindexLoaded->nHeight, pindex->nHeight);
+        BOOST_CHECK_EQUAL(pindexLoaded->nStatus, pindex->nStatus);
+        BOOST_CHECK_EQUAL(pindexLoaded->nTx, pindex->nTx);
+        BOOST_CHECK_EQUAL(pindexLoaded->nFile, pindex->nFile);
+        BOOST_CHECK_EQUAL(pindexLoaded->nDataPos, pindex->nDataPos);
+        BOOST_CHECK_EQUAL(pindexLoaded->nUndoPos, pindex->nUndoPos);
+    }
+
+    // A truncated file is rejected
+    fs::resize_file(path, fs::file_size(path) - 1);
+    mapLoaded.clear();
+    arena.Clear();
+    BOOST_CHECK(!LoadBlockIndexFile(path, 42, mapLoaded, arena));
+    BOOST_CHECK(mapLoaded.empty());
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(blockindexfile_reload)
+{
+    const CChainParams& chainparams = Params();
+    fFlatBlockIndex = true;
+    {
+        LOCK(cs_main);
+        const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+        const size_t nEntries = mapBlockIndex.size();
+        FlushStateToDisk();
+        BOOST_CHECK(WriteFlatBlockIndex());
+
+        UnloadBlockIndex();
+        BOOST_CHECK(LoadBlockIndex(chainparams));
+        BOOST_CHECK_EQUAL(mapBlockIndex.size(), nEntries);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+    }
+
+    // Blocks connected on top of the loaded index are written to the
+    // database, which makes the file stale
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        uint64_t nStamp;
+        BOOST_CHECK(!pblocktree->ReadFlatIndexStamp(nStamp));
+        const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+        UnloadBlockIndex();
+        BOOST_CHECK(LoadBlockIndex(chainparams));
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+    }
+    fFlatBlockIndex = DEFAULT_FLATBLOCKINDEX;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
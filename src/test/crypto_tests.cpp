@@ -10,6 +10,8 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
+#include "streams.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
@@ -269,6 +271,29 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Compare against hashing each input separately, for counts that exercise
+    // every mix of the multi-way kernels and the single one.
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            unsigned char hash[CSHA256::OUTPUT_SIZE];
+            CSHA256().Write(in + 64 * j, 64).Finalize(hash);
+            CSHA256().Write(hash, sizeof(hash)).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+        // In place, as done for merkle trees
+        SHA256D64(in, in, i);
+        BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -484,6 +509,62 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+static MuHash3072 FromInt(unsigned char i) {
+    unsigned char tmp[32] = {i, 0};
+    return MuHash3072(tmp, sizeof(tmp));
+}
+
+static uint256 MuHashFinal(MuHash3072 muhash) {
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    // Elements can be added and removed in any order
+    std::vector<unsigned char> elems;
+    for (int i = 0; i < 4; i++)
+        elems.push_back(InsecureRandBits(2));
+    MuHash3072 acc1, acc2, acc3;
+    for (int i = 0; i < 4; i++) {
+        acc1 *= FromInt(elems[i]);
+        acc2 *= FromInt(elems[3 - i]);
+    }
+    BOOST_CHECK(MuHashFinal(acc1) == MuHashFinal(acc2));
+    acc3 *= FromInt(elems[0]);
+    acc3 *= FromInt(elems[1]);
+    acc3 /= FromInt(elems[2]);
+    acc3 *= FromInt(elems[2]);
+    acc3 *= FromInt(elems[2]);
+    acc3 /= FromInt(elems[2]);
+    acc3 *= FromInt(elems[3]);
+    acc3 *= FromInt(elems[2]);
+    BOOST_CHECK(MuHashFinal(acc3) == MuHashFinal(acc1));
+
+    // Removing everything that was added gives the hash of the empty set
+    MuHash3072 empty;
+    unsigned char data[4] = {1, 2, 3, 4};
+    MuHash3072 acc4;
+    acc4.Insert(data, sizeof(data));
+    BOOST_CHECK(MuHashFinal(acc4) == MuHashFinal(MuHash3072(data, sizeof(data))));
+    BOOST_CHECK(MuHashFinal(acc4) != MuHashFinal(empty));
+    acc4.Remove(data, sizeof(data));
+    BOOST_CHECK(MuHashFinal(acc4) == MuHashFinal(empty));
+
+    // Serialization keeps the state, unfinalized or not
+    CDataStream ss(SER_DISK, 0);
+    ss << acc3;
+    MuHash3072 acc5;
+    ss >> acc5;
+    BOOST_CHECK(MuHashFinal(acc5) == MuHashFinal(acc1));
+
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    BOOST_CHECK_EQUAL(MuHashFinal(acc).GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
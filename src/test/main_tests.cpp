@@ -30,4 +30,25 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_FIXTURE_TEST_CASE(block_read_ahead, TestChain240Setup)
+{
+    // Reconnecting more blocks than ActivateBestChainStep looks at in one go
+    // has them read ahead over several steps.
+    const CChainParams& chainparams = Params();
+    CBlockIndex* pindexTip = chainActive.Tip();
+    CBlockIndex* pindexFork = chainActive[chainActive.Height() - 50];
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, chainparams, chainActive.Next(pindexFork)));
+        BOOST_CHECK(chainActive.Tip() == pindexFork);
+        BOOST_CHECK(ResetBlockFailureFlags(pindexTip));
+    }
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK(chainActive.Tip() == pindexTip);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == pindexTip->GetBlockHash());
+}
 BOOST_AUTO_TEST_SUITE_END()
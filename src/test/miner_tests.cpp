@@ -8,6 +8,8 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "dogecoin.h"
+#include "key.h"
 #include "validation.h"
 #include "miner.h"
 #include "policy/policy.h"
@@ -497,4 +499,96 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+static bool ToMemPool(const CMutableTransaction& tx)
+{
+    LOCK(cs_main);
+    CValidationState state;
+    return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), false, NULL, NULL, true, 0);
+}
+
+static CMutableTransaction CreateSpend(const CTransaction& txPrev, const CScript& scriptPubKey, const CKey& key, CAmount nFee)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txPrev.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(txPrev.vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    key.Sign(hash, vchSig);
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+static std::set<uint256> GetBlockTxids(const CBlock& block)
+{
+    std::set<uint256> setTxids;
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        setTxids.insert(block.vtx[i]->GetHash());
+    return setTxids;
+}
+
+BOOST_FIXTURE_TEST_CASE(IncrementalBlockAssembler_follows_mempool, TestChain240Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = CreateIncrementalBlock(chainparams, scriptPubKey, false);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+
+    // A parent and its child are appended in order, a spend of another coin after them
+    CMutableTransaction txParent = CreateSpend(coinbaseTxns[0], scriptPubKey, coinbaseKey, COIN);
+    CMutableTransaction txChild = CreateSpend(txParent, scriptPubKey, coinbaseKey, 2 * COIN);
+    CMutableTransaction txOther = CreateSpend(coinbaseTxns[1], scriptPubKey, coinbaseKey, COIN);
+    BOOST_CHECK(ToMemPool(txParent));
+    BOOST_CHECK(ToMemPool(txChild));
+    BOOST_CHECK(ToMemPool(txOther));
+
+    pblocktemplate = CreateIncrementalBlock(chainparams, scriptPubKey, false);
+    const CBlock& block = pblocktemplate->block;
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), 4);
+    BOOST_CHECK(block.vtx[1]->GetHash() == txParent.GetHash());
+    BOOST_CHECK(block.vtx[2]->GetHash() == txChild.GetHash());
+    BOOST_CHECK(block.vtx[3]->GetHash() == txOther.GetHash());
+    BOOST_CHECK(block.vtx[0]->vout[0].scriptPubKey == scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -4 * COIN);
+    {
+        LOCK(cs_main);
+        const CAmount nSubsidy = GetDogecoinBlockSubsidy(chainActive.Height() + 1, chainparams.GetConsensus(chainActive.Height() + 1), chainActive.Tip()->GetBlockHash());
+        BOOST_CHECK_EQUAL(block.vtx[0]->vout[0].nValue, nSubsidy + 4 * COIN);
+        CValidationState state;
+        BOOST_CHECK(TestBlockValidity(state, chainparams, block, chainActive.Tip(), false, false));
+    }
+
+    // It selects what a full selection does
+    std::unique_ptr<CBlockTemplate> pfulltemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey, false);
+    BOOST_CHECK(GetBlockTxids(block) == GetBlockTxids(pfulltemplate->block));
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], pfulltemplate->vTxFees[0]);
+
+    // Removing the parent takes the child with it
+    mempool.removeRecursive(txParent, MemPoolRemovalReason::CONFLICT);
+    pblocktemplate = CreateIncrementalBlock(chainparams, scriptPubKey, false);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txOther.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -COIN);
+
+    // A fee delta is picked up
+    mempool.PrioritiseTransaction(txOther.GetHash(), txOther.GetHash().ToString(), 0.0, COIN);
+    BOOST_CHECK(ToMemPool(txParent));
+    pblocktemplate = CreateIncrementalBlock(chainparams, scriptPubKey, false);
+    BOOST_CHECK(GetBlockTxids(pblocktemplate->block) == GetBlockTxids(BlockAssembler(chainparams).CreateNewBlock(scriptPubKey, false)->block));
+
+    // A new tip starts over
+    std::vector<CMutableTransaction> vSpends;
+    vSpends.push_back(txParent);
+    vSpends.push_back(txOther);
+    CreateAndProcessBlock(vSpends, scriptPubKey);
+    pblocktemplate = CreateIncrementalBlock(chainparams, scriptPubKey, false);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+    BOOST_CHECK(pblocktemplate->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
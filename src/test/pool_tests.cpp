@@ -0,0 +1,82 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "memusage.h"
+#include "support/allocators/pool.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_resource)
+{
+    PoolResource<64> resource;
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), 0U);
+
+    // Sizes are rounded up to the alignment
+    void* p1 = resource.Allocate(20, 4);
+    void* p2 = resource.Allocate(24, 8);
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), 48U);
+    BOOST_CHECK_EQUAL((char*)p2 - (char*)p1, 24);
+    BOOST_CHECK_EQUAL(resource.ChunkUsage(), memusage::MallocUsage(PoolResource<64>::MIN_CHUNK_SIZE_BYTES));
+
+    // Freed blocks are reused for the same size
+    resource.Deallocate(p1, 20, 4);
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), 24U);
+    BOOST_CHECK(resource.Allocate(24, 8) == p1);
+    BOOST_CHECK(resource.Allocate(24, 8) != p1);
+
+    // Large allocations bypass the pool
+    void* p3 = resource.Allocate(1000, 8);
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), 72U + memusage::MallocUsage(1000));
+    resource.Deallocate(p3, 1000, 8);
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), 72U);
+
+    // Chunks grow as they fill up
+    for (int i = 0; i < 1000; i++)
+        resource.Allocate(64, 8);
+    BOOST_CHECK(resource.ChunkUsage() > memusage::MallocUsage(PoolResource<64>::MIN_CHUNK_SIZE_BYTES * 3));
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), 72U + 64000U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_coins_map)
+{
+    CCoinsMap map;
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        CCoinsCacheEntry& entry = map[COutPoint(InsecureRand256(), i)];
+        entry.coin.out.nValue = i;
+    }
+    // Each node costs less than it would as a separate malloc
+    size_t nUsage = memusage::DynamicUsage(map);
+    size_t nMallocUsage = memusage::MallocUsage(sizeof(memusage::boost_unordered_node<CCoinsMap::value_type>)) * map.size() + memusage::MallocUsage(sizeof(void*) * map.bucket_count());
+    BOOST_CHECK(nUsage > sizeof(CCoinsMap::value_type) * map.size());
+    BOOST_CHECK(nUsage < nMallocUsage);
+
+    // A copy has its own pool, and swapping exchanges the pools
+    CCoinsMap copy(map);
+    BOOST_CHECK(copy.get_allocator() != map.get_allocator());
+    CCoinsMap other;
+    other.swap(map);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(other), nUsage);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+    BOOST_CHECK_EQUAL(other.size(), 1000U);
+    BOOST_CHECK_EQUAL(copy.size(), 1000U);
+
+    // Erased nodes no longer count
+    for (CCoinsMap::iterator it = other.begin(); it != other.end();) {
+        if (it->second.coin.out.nValue % 2)
+            it = other.erase(it);
+        else
+            it++;
+    }
+    BOOST_CHECK(memusage::DynamicUsage(other) < nUsage);
+    other.clear();
+    BOOST_CHECK(memusage::DynamicUsage(other) <= memusage::MallocUsage(sizeof(void*) * (other.bucket_count() + 1)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
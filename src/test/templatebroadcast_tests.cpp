@@ -0,0 +1,111 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "templatebroadcast.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "script/standard.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(templatebroadcast_tests, TestChain240Setup)
+
+static bool SpendToMemPool(const CTransaction& txPrev, const CKey& key, CMutableTransaction& tx)
+{
+    tx = CMutableTransaction();
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txPrev.vout[0].nValue - COIN;
+    tx.vout[0].scriptPubKey = txPrev.vout[0].scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(txPrev.vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    key.Sign(hash, vchSig);
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+
+    LOCK(cs_main);
+    CValidationState state;
+    return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), false, NULL, NULL, true, 0);
+}
+
+BOOST_AUTO_TEST_CASE(templatebroadcast_waiters)
+{
+    // No scheduler: tip changes refresh on the notifying thread. A zero
+    // refresh interval makes any mempool change warrant a new template.
+    CTemplateBroadcaster broadcaster(NULL, false, 0);
+    RegisterValidationInterface(&broadcaster);
+
+    // Inactive until asked for a template
+    broadcaster.Refresh();
+    std::shared_ptr<const CSharedBlockTemplate> ptemplate = broadcaster.Get();
+    BOOST_REQUIRE(ptemplate);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(ptemplate->nHeight, chainActive.Height() + 1);
+        BOOST_CHECK(ptemplate->block->hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    }
+    BOOST_CHECK(ptemplate->hash == ptemplate->block->GetHash());
+    BOOST_CHECK_EQUAL(ptemplate->block->vtx.size(), 1);
+    BOOST_CHECK(!ptemplate->strBinary.empty());
+    BOOST_CHECK_EQUAL(ptemplate->strHex.size(), 2 * ptemplate->strBinary.size() + 1);
+
+    // Nothing changed: same template
+    broadcaster.Refresh();
+    BOOST_CHECK(broadcaster.Get() == ptemplate);
+
+    // A waiter which does not know the current template is answered at once
+    std::vector<std::shared_ptr<const CSharedBlockTemplate> > vReceived;
+    CTemplateBroadcaster::Callback callback = [&vReceived](const std::shared_ptr<const CSharedBlockTemplate>& p) { vReceived.push_back(p); };
+    broadcaster.Wait(uint256(), callback);
+    BOOST_REQUIRE_EQUAL(vReceived.size(), 1);
+    BOOST_CHECK(vReceived[0] == ptemplate);
+
+    // One which does is parked until there is a new template
+    broadcaster.Wait(ptemplate->hash, callback);
+    broadcaster.Wait(ptemplate->hash, callback);
+    BOOST_CHECK_EQUAL(vReceived.size(), 1);
+    BOOST_CHECK_EQUAL(broadcaster.GetWaiterCount(), 2);
+    broadcaster.Refresh();
+    BOOST_CHECK_EQUAL(broadcaster.GetWaiterCount(), 2);
+
+    CMutableTransaction tx;
+    BOOST_CHECK(SpendToMemPool(coinbaseTxns[0], coinbaseKey, tx));
+    broadcaster.Refresh();
+    BOOST_REQUIRE_EQUAL(vReceived.size(), 3);
+    BOOST_CHECK_EQUAL(broadcaster.GetWaiterCount(), 0);
+    BOOST_CHECK(vReceived[1] == vReceived[2]);
+    BOOST_CHECK(vReceived[1] != ptemplate);
+    BOOST_CHECK_EQUAL(vReceived[1]->block->vtx.size(), 2);
+    BOOST_CHECK_EQUAL(vReceived[1]->nFees, COIN);
+    ptemplate = vReceived[1];
+
+    // A new tip releases waiters without an explicit refresh
+    broadcaster.Wait(ptemplate->hash, callback);
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(1, tx), scriptPubKey);
+    BOOST_REQUIRE_EQUAL(vReceived.size(), 4);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(vReceived[3]->block->hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    }
+    BOOST_CHECK_EQUAL(vReceived[3]->block->vtx.size(), 1);
+    ptemplate = vReceived[3];
+
+    // Interrupting releases waiters with no template, and refuses new ones
+    broadcaster.Wait(ptemplate->hash, callback);
+    broadcaster.Interrupt();
+    BOOST_REQUIRE_EQUAL(vReceived.size(), 5);
+    BOOST_CHECK(!vReceived[4]);
+    broadcaster.Wait(ptemplate->hash, callback);
+    BOOST_REQUIRE_EQUAL(vReceived.size(), 6);
+    BOOST_CHECK(!vReceived[5]);
+    BOOST_CHECK_EQUAL(broadcaster.GetWaiterCount(), 0);
+
+    UnregisterValidationInterface(&broadcaster);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -44,10 +44,12 @@ static const int COINBASE_MATURITY = 60*4; // 4 hours of blocks
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
         RandomInit();
+        SHA256AutoDetect();
         ECC_Start();
         SetupEnvironment();
         SetupNetworking();
         InitSignatureCache();
+        InitScriptExecutionCache();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(chainName);
@@ -73,17 +75,29 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         ForceSetArg("-datadir", pathTemp.string());
         mempool.setSanityCheck(1.0);
         pblocktree = new CBlockTreeDB(1 << 20, true);
+        ppowcache = new CPoWCacheDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinsflusher = new CCoinsViewFlusher(pcoinsdbview, pcoinsdbview);
+        pcoinsTip = new CCoinsViewCache(pcoinsflusher);
         InitBlockIndex(chainparams);
         {
             CValidationState state;
             bool ok = ActivateBestChain(state, chainparams);
             BOOST_CHECK(ok);
         }
+        BOOST_CHECK(LoadUTXOSetHash());
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadSigVerify);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadBlockReadAhead);
+        threadGroup.create_thread(&ThreadFlushCoins);
         g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
         connman = g_connman.get();
         RegisterNodeSignals(GetNodeSignals());
@@ -96,8 +110,11 @@ TestingSetup::~TestingSetup()
         threadGroup.join_all();
         UnloadBlockIndex();
         delete pcoinsTip;
+        delete pcoinsflusher;
         delete pcoinsdbview;
         delete pblocktree;
+        delete ppowcache;
+        ppowcache = NULL;
         fs::remove_all(pathTemp);
 }
 
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "consensus/validation.h"
 #include "key.h"
 #include "validation.h"
@@ -85,4 +86,209 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain240Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+static CMutableTransaction
+SpendWithKey(const std::vector<COutPoint>& vPrevouts, const CScript& scriptCode, const CKey& key, const CScript& scriptPubKey, CAmount nValue = COIN)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(vPrevouts.size());
+    for (unsigned int i = 0; i < vPrevouts.size(); i++)
+        tx.vin[i].prevout = vPrevouts[i];
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptCode, tx, i, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[i].scriptSig = CScript() << vchSig;
+    }
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_deferred_sigchecks, TestChain240Setup)
+{
+    // Blocks verify their signatures after running the scripts, assuming
+    // them valid meanwhile. Make sure that gives the same outcome as
+    // verifying them inline.
+    BOOST_CHECK(fDeferSigChecks && nScriptCheckThreads > 1);
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CScript scriptInvalidSig = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG << OP_NOT;
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    // Several inputs signed with the same key share one parsed public key
+    std::vector<COutPoint> vPrevouts;
+    for (int i = 0; i < 3; i++)
+        vPrevouts.push_back(COutPoint(coinbaseTxns[i].GetHash(), 0));
+    CMutableTransaction spendMany = SpendWithKey(vPrevouts, scriptPubKey, coinbaseKey, scriptInvalidSig);
+    CBlock block = CreateAndProcessBlock({spendMany}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    // A signature by the wrong key is rejected...
+    CMutableTransaction spendBad = SpendWithKey({COutPoint(coinbaseTxns[3].GetHash(), 0)}, scriptPubKey, otherKey, scriptPubKey);
+    block = CreateAndProcessBlock({spendBad}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+
+    // ... unless the script requires it to be invalid
+    CMutableTransaction spendInvalidSig = SpendWithKey({COutPoint(spendMany.GetHash(), 0)}, scriptInvalidSig, otherKey, scriptPubKey);
+    block = CreateAndProcessBlock({spendInvalidSig}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_script_execution_cache, TestChain240Setup)
+{
+    // Transactions accepted to the mempool are checked with the flags of the
+    // next block and cached, so that the block connecting them does not have
+    // to run their scripts again.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend = SpendWithKey({COutPoint(coinbaseTxns[0].GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptPubKey);
+    BOOST_CHECK(ToMemPool(spend));
+
+    LOCK(cs_main);
+    unsigned int flags = GetBlockScriptFlags(chainActive.Tip(), chainActive.Height() + 1, Params());
+    CCoinsViewCache view(pcoinsTip);
+    CTransaction tx(spend);
+    PrecomputedTransactionData txdata(tx);
+    CValidationState state;
+
+    // The block's flags are cached...
+    std::vector<CScriptCheck> vChecks;
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, false, txdata, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+
+    // ... but no other flags
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags ^ SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY, false, false, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+
+    // Checks run on the script check threads are not cached
+    unsigned int flagsOther = flags ^ SCRIPT_VERIFY_DERSIG;
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flagsOther, true, true, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flagsOther, true, true, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // Only those run inline are
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flagsOther, true, true, txdata));
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flagsOther, false, false, txdata, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+
+    // A transaction failing its scripts is not cached either
+    CMutableTransaction spendBad = spend;
+    spendBad.vin[0].scriptSig = CScript() << OP_0;
+    CTransaction txBad(spendBad);
+    PrecomputedTransactionData txdataBad(txBad);
+    BOOST_CHECK(!CheckInputs(txBad, state, view, true, flags, true, true, txdataBad));
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(txBad, state, view, true, flags, false, false, txdataBad, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_unlocked, TestChain240Setup)
+{
+    // Transactions submitted without cs_main have their scripts checked
+    // concurrently, and are re-checked against the mempool before being added.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    std::vector<CTransactionRef> vtx;
+    for (int i = 0; i < 8; i++)
+        vtx.push_back(MakeTransactionRef(SpendWithKey({COutPoint(coinbaseTxns[i].GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptPubKey)));
+    // Two spends of the same coin: only one of them may be accepted
+    CScript scriptOther = CScript() <<  ToByteVector(otherKey.GetPubKey()) << OP_CHECKSIG;
+    vtx.push_back(MakeTransactionRef(SpendWithKey({COutPoint(coinbaseTxns[8].GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptPubKey)));
+    vtx.push_back(MakeTransactionRef(SpendWithKey({COutPoint(coinbaseTxns[8].GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptOther)));
+    // A signature by the wrong key
+    vtx.push_back(MakeTransactionRef(SpendWithKey({COutPoint(coinbaseTxns[9].GetHash(), 0)}, scriptPubKey, otherKey, scriptPubKey)));
+
+    std::vector<char> vAccepted(vtx.size(), false);
+    boost::thread_group threads;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        threads.create_thread([&vtx, &vAccepted, i] {
+            CValidationState state;
+            vAccepted[i] = AcceptToMemoryPoolUnlocked(mempool, state, vtx[i], false, NULL, NULL, true, 0);
+        });
+    }
+    threads.join_all();
+
+    for (int i = 0; i < 8; i++)
+        BOOST_CHECK(vAccepted[i]);
+    BOOST_CHECK(vAccepted[8] != vAccepted[9]);
+    BOOST_CHECK(!vAccepted[10]);
+    BOOST_CHECK_EQUAL(mempool.size(), 9U);
+    for (size_t i = 0; i < vtx.size(); i++)
+        BOOST_CHECK_EQUAL(mempool.exists(vtx[i]->GetHash()), (bool)vAccepted[i]);
+
+    // A block with the accepted transactions connects
+    std::vector<CMutableTransaction> vBlockTxs;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vAccepted[i])
+            vBlockTxs.push_back(CMutableTransaction(*vtx[i]));
+    }
+    CBlock block = CreateAndProcessBlock(vBlockTxs, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch, TestChain240Setup)
+{
+    // A batch is accepted parents first, whatever order it is given in
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CScript scriptOther = CScript() <<  ToByteVector(otherKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction parent = SpendWithKey({COutPoint(coinbaseTxns[0].GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptPubKey, 3 * COIN);
+    CMutableTransaction child = SpendWithKey({COutPoint(parent.GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptPubKey, 2 * COIN);
+    CMutableTransaction grandchild = SpendWithKey({COutPoint(child.GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptPubKey);
+    CMutableTransaction spend = SpendWithKey({COutPoint(coinbaseTxns[1].GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptPubKey);
+    CMutableTransaction spendConflict = SpendWithKey({COutPoint(coinbaseTxns[1].GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptOther);
+    CMutableTransaction spendBad = SpendWithKey({COutPoint(coinbaseTxns[2].GetHash(), 0)}, scriptPubKey, otherKey, scriptPubKey, 3 * COIN);
+    CMutableTransaction spendBadChild = SpendWithKey({COutPoint(spendBad.GetHash(), 0)}, scriptPubKey, coinbaseKey, scriptPubKey);
+
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(grandchild));
+    vtx.push_back(MakeTransactionRef(spend));
+    vtx.push_back(MakeTransactionRef(child));
+    vtx.push_back(MakeTransactionRef(spendBad));
+    vtx.push_back(MakeTransactionRef(spendConflict));
+    vtx.push_back(MakeTransactionRef(parent));
+    vtx.push_back(MakeTransactionRef(spendBadChild));
+
+    std::vector<CValidationState> vState;
+    std::vector<bool> vMissingInputs;
+    std::vector<bool> vAccepted = AcceptToMemoryPoolBatch(mempool, vtx, vState, vMissingInputs, false);
+    BOOST_REQUIRE_EQUAL(vAccepted.size(), vtx.size());
+    BOOST_CHECK(vAccepted[0] && vAccepted[1] && vAccepted[2] && vAccepted[5]);
+    // Of two conflicting transactions, the first one given wins
+    BOOST_CHECK(!vAccepted[4]);
+    BOOST_CHECK_EQUAL(vState[4].GetRejectReason(), "txn-mempool-conflict");
+    // A failing script is told apart from the valid ones checked with it
+    BOOST_CHECK(!vAccepted[3]);
+    BOOST_CHECK(vState[3].IsInvalid());
+    // ... and its child misses its inputs
+    BOOST_CHECK(!vAccepted[6]);
+    BOOST_CHECK(vMissingInputs[6]);
+    BOOST_CHECK(vState[6].IsValid());
+    BOOST_CHECK_EQUAL(mempool.size(), 4U);
+
+    // Transactions already in the mempool are rejected as such
+    vAccepted = AcceptToMemoryPoolBatch(mempool, std::vector<CTransactionRef>(1, vtx[5]), vState, vMissingInputs, false);
+    BOOST_CHECK(!vAccepted[0]);
+    BOOST_CHECK_EQUAL(vState[0].GetRejectReason(), "txn-already-in-mempool");
+
+    // A block with the accepted transactions connects
+    std::vector<CMutableTransaction> vBlockTxs = {parent, child, grandchild, spend};
+    CBlock block = CreateAndProcessBlock(vBlockTxs, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
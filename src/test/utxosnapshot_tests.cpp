@@ -0,0 +1,172 @@
+// Copyright (c) 2025 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestChain240Setup)
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_dump_load)
+{
+    const CChainParams& chainparams = Params();
+    fs::path path = pathTemp / "utxo.dat";
+
+    CUTXOSnapshotMetadata metadata;
+    CCoinsStats stats;
+    BOOST_CHECK(DumpUTXOSnapshot(path, metadata, stats));
+
+    // The snapshot carries the hash gettxoutsetinfo reports
+    CCoinsStats statsTip;
+    BOOST_CHECK(GetUTXOStats(pcoinsTip, statsTip));
+    BOOST_CHECK(stats.hashSerialized == statsTip.hashSerialized);
+    BOOST_CHECK_EQUAL(metadata.nCoins, statsTip.nTransactionOutputs);
+    BOOST_CHECK(metadata.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(metadata.nChainTx, chainActive.Tip()->nChainTx);
+
+    // A snapshot is only loaded if it has the expected hash...
+    CValidationState state;
+    CUTXOSnapshotMetadata metadataLoaded;
+    BOOST_CHECK(!LoadUTXOSnapshot(state, chainparams, path, uint256(), metadataLoaded));
+    // ... and extends the current tip
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(state, chainparams, path, stats.hashSerialized, metadataLoaded));
+    BOOST_CHECK(!fHaveSnapshot);
+
+    // Rewind a few blocks and forget their data, as if only their headers
+    // had been received
+    CBlockIndex* pindexSnapshot = chainActive.Tip();
+    CBlockIndex* pindexFork = chainActive[chainActive.Height() - 5];
+    {
+        LOCK(cs_main);
+        state = CValidationState();
+        BOOST_CHECK(InvalidateBlock(state, chainparams, chainActive.Next(pindexFork)));
+        BOOST_CHECK(chainActive.Tip() == pindexFork);
+        for (CBlockIndex* pindex = pindexSnapshot; pindex != pindexFork; pindex = pindex->pprev) {
+            pindex->nStatus = BLOCK_VALID_TREE;
+            pindex->nTx = 0;
+            pindex->nChainTx = 0;
+            pindex->nSequenceId = 0;
+        }
+    }
+
+    state = CValidationState();
+    BOOST_CHECK(LoadUTXOSnapshot(state, chainparams, path, stats.hashSerialized, metadataLoaded));
+    BOOST_CHECK(metadataLoaded.hashBlock == metadata.hashBlock);
+    BOOST_CHECK(chainActive.Tip() == pindexSnapshot);
+    BOOST_CHECK_EQUAL(chainActive.Tip()->nChainTx, metadata.nChainTx);
+    BOOST_CHECK(fHaveSnapshot);
+    BOOST_CHECK(!(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA));
+
+    CCoinsStats statsLoaded;
+    BOOST_CHECK(GetUTXOStats(pcoinsTip, statsLoaded));
+    BOOST_CHECK(statsLoaded.hashSerialized == stats.hashSerialized);
+
+    // The rolling UTXO set hash starts over from the snapshot
+    CUTXOSetHash hashTip, hashLoaded;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(GetUTXOSetHash(hashTip));
+    }
+    BOOST_CHECK(ComputeUTXOSetHash(pcoinsdbview, hashLoaded));
+    BOOST_CHECK(hashTip.GetHash() == hashLoaded.GetHash());
+
+    // The chain carries on from the snapshot block
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->pprev == pindexSnapshot);
+
+    // Only one snapshot can be loaded
+    state = CValidationState();
+    BOOST_CHECK(!LoadUTXOSnapshot(state, chainparams, path, stats.hashSerialized, metadataLoaded));
+}
+
+static uint256 GetUTXOSetHashTip()
+{
+    CUTXOSetHash hash;
+    LOCK(cs_main);
+    BOOST_CHECK(GetUTXOSetHash(hash));
+    return hash.GetHash();
+}
+
+static uint256 ComputeUTXOSetHashTip()
+{
+    FlushStateToDisk();
+    CUTXOSetHash hash;
+    BOOST_CHECK(ComputeUTXOSetHash(pcoinsdbview, hash));
+    return hash.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(utxo_set_hash)
+{
+    const CChainParams& chainparams = Params();
+
+    // The rolling hash follows the chain
+    uint256 hashTip = ComputeUTXOSetHashTip();
+    BOOST_CHECK(GetUTXOSetHashTip() == hashTip);
+    CUTXOSetHash hash;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(GetUTXOSetHash(hash));
+    }
+    CCoinsStats stats;
+    BOOST_CHECK(GetUTXOStats(pcoinsTip, stats));
+    BOOST_CHECK_EQUAL(hash.nTransactionOutputs, stats.nTransactionOutputs);
+    BOOST_CHECK(arith_uint256(hash.nTotalAmount) == stats.nTotalAmount);
+
+    // Spending a coin changes it
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = coinbaseTxns[0].vout[0].nValue / 2;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[1].nValue = coinbaseTxns[0].vout[0].nValue / 4;
+    tx.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    std::vector<unsigned char> vchSig;
+    uint256 sighash = SignatureHash(coinbaseTxns[0].vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(sighash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({tx}, scriptPubKey);
+    BOOST_CHECK(GetUTXOSetHashTip() != hashTip);
+    BOOST_CHECK(GetUTXOSetHashTip() == ComputeUTXOSetHashTip());
+
+    // It is written with the best block
+    CUTXOSetHash hashStored;
+    BOOST_CHECK(pcoinsdbview->GetUTXOSetHash(hashStored));
+    BOOST_CHECK(hashStored.GetHash() == GetUTXOSetHashTip());
+
+    // Disconnecting blocks brings it back
+    CBlockIndex* pindexTip = chainActive.Tip();
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, chainparams, pindexTip));
+    }
+    BOOST_CHECK(GetUTXOSetHashTip() == hashTip);
+    BOOST_CHECK(GetUTXOSetHashTip() == ComputeUTXOSetHashTip());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(ResetBlockFailureFlags(pindexTip));
+    }
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    BOOST_CHECK(chainActive.Tip() == pindexTip);
+    BOOST_CHECK(GetUTXOSetHashTip() == hashStored.GetHash());
+
+    // And it is loaded back from the database
+    BOOST_CHECK(LoadUTXOSetHash());
+    BOOST_CHECK(GetUTXOSetHashTip() == hashStored.GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,34 +7,66 @@
 
 #include "chainparams.h"
 #include "hash.h"
+#include "init.h"
+#include "memusage.h"
 #include "pow.h"
 #include "uint256.h"
+#include "ui_interface.h"
+#include "util.h"
 
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
+static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_POW_HASH = 'p';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_UTXO_SET_HASH = 'M';
+static const char DB_FLAT_INDEX_STAMP = 'I';
 
 
+namespace {
+
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN)  {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << outpoint->hash;
+        s << VARINT(outpoint->n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> outpoint->hash;
+        s >> VARINT(outpoint->n);
+    }
+};
+
+}
+
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
 {
 }
 
-bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(std::make_pair(DB_COINS, txid), coins);
+bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    return db.Read(CoinEntry(&outpoint), coin);
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(std::make_pair(DB_COINS, txid));
+bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -50,23 +82,201 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(std::make_pair(DB_COINS, it->first));
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
             else
-                batch.Write(std::make_pair(DB_COINS, it->first), it->second.coins);
+                batch.Write(entry, it->second.coin);
             changed++;
         }
         count++;
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
-    if (!hashBlock.IsNull())
+    if (!hashBlock.IsNull()) {
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+        WriteUTXOSetHash(batch, hashBlock);
+    }
+
+    LogPrint("coindb", "Committing %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    return db.WriteBatch(batch);
+}
+
+bool CCoinsViewDB::WriteCoinsMap(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    CDBBatch batch(db);
+    size_t changed = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
+            else
+                batch.Write(entry, it->second.coin);
+            changed++;
+        }
+    }
+    if (!hashBlock.IsNull()) {
         batch.Write(DB_BEST_BLOCK, hashBlock);
+        WriteUTXOSetHash(batch, hashBlock);
+    }
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transaction outputs to coin database in the background...\n", (unsigned int)changed);
     return db.WriteBatch(batch);
 }
 
+void CCoinsViewDB::SetUTXOSetHash(const uint256 &hashBlock, const CUTXOSetHash &hash) {
+    boost::unique_lock<boost::mutex> lock(mutexUTXOSetHash);
+    mapUTXOSetHash[hashBlock] = hash;
+}
+
+void CCoinsViewDB::WriteUTXOSetHash(CDBBatch &batch, const uint256 &hashBlock) {
+    // Without a hash for hashBlock, the one stored for an earlier best block
+    // is left in place; GetUTXOSetHash will not return it.
+    boost::unique_lock<boost::mutex> lock(mutexUTXOSetHash);
+    std::map<uint256, CUTXOSetHash>::iterator it = mapUTXOSetHash.find(hashBlock);
+    if (it != mapUTXOSetHash.end()) {
+        batch.Write(DB_UTXO_SET_HASH, std::make_pair(hashBlock, it->second));
+        mapUTXOSetHash.erase(it);
+    }
+}
+
+bool CCoinsViewDB::GetUTXOSetHash(CUTXOSetHash &hash) const {
+    std::pair<uint256, CUTXOSetHash> entry;
+    if (!db.Read(DB_UTXO_SET_HASH, entry))
+        return false;
+    if (entry.first != GetBestBlock())
+        return false;
+    hash = entry.second;
+    return true;
+}
+
+CCoinsViewFlusher::CCoinsViewFlusher(CCoinsView *viewIn, CCoinsViewDB *dbIn) : CCoinsViewBacked(viewIn), pdb(dbIn), nFrozenUsage(0), fPending(false), fRunning(false), fFailed(false) {
+}
+
+bool CCoinsViewFlusher::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap::const_iterator it = mapFrozen.find(outpoint);
+        if (it != mapFrozen.end()) {
+            coin = it->second.coin;
+            return !coin.IsSpent();
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewFlusher::HaveCoin(const COutPoint &outpoint) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap::const_iterator it = mapFrozen.find(outpoint);
+        if (it != mapFrozen.end())
+            return !it->second.coin.IsSpent();
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewFlusher::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!hashFrozen.IsNull())
+            return hashFrozen;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlusher::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (fFailed)
+        return false;
+    if (!fRunning) {
+        lock.unlock();
+        return base->BatchWrite(mapCoins, hashBlock);
+    }
+
+    // Only wait if the cache filled up again before the previous write finished.
+    if (fPending) {
+        boost::this_thread::disable_interruption di;
+        int64_t nStart = GetTimeMicros();
+        while (fPending)
+            cond.wait(lock);
+        LogPrint("coindb", "Waited %.2fms for the previous coin database write\n", (GetTimeMicros() - nStart) * 0.001);
+        if (fFailed)
+            return false;
+    }
+
+    // Take over the caller's entries, keeping only those that need writing.
+    mapFrozen.swap(mapCoins);
+    mapCoins.clear();
+    nFrozenUsage = 0;
+    for (CCoinsMap::iterator it = mapFrozen.begin(); it != mapFrozen.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            nFrozenUsage += it->second.coin.DynamicMemoryUsage();
+            it++;
+        } else {
+            it = mapFrozen.erase(it);
+        }
+    }
+    nFrozenUsage += memusage::DynamicUsage(mapFrozen);
+    hashFrozen = hashBlock;
+    fPending = true;
+    cond.notify_all();
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewFlusher::Cursor() const {
+    Sync();
+    return base->Cursor();
+}
+
+bool CCoinsViewFlusher::Sync() const {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    boost::this_thread::disable_interruption di;
+    while (fPending)
+        cond.wait(lock);
+    return !fFailed;
+}
+
+size_t CCoinsViewFlusher::DynamicMemoryUsage() const {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nFrozenUsage;
+}
+
+void CCoinsViewFlusher::Thread() {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fRunning = true;
+    try {
+        while (true) {
+            while (!fPending)
+                cond.wait(lock);
+
+            // mapFrozen stays readable by others while it is written.
+            lock.unlock();
+            bool fOk = false;
+            try {
+                fOk = pdb->WriteCoinsMap(mapFrozen, hashFrozen);
+            } catch (const std::runtime_error& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+            lock.lock();
+
+            if (fOk) {
+                CCoinsMap().swap(mapFrozen);
+                hashFrozen.SetNull();
+                nFrozenUsage = 0;
+            } else {
+                // Keep the entries readable; the next flush reports the failure.
+                LogPrintf("%s: failed to write to coin database\n", __func__);
+                fFailed = true;
+            }
+            fPending = false;
+            cond.notify_all();
+        }
+    } catch (const boost::thread_interrupted&) {
+        fRunning = false;
+        throw;
+    }
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -96,29 +306,31 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COINS);
+    i->pcursor->Seek(DB_COIN);
     // Cache key of first record
     if (i->pcursor->Valid()) {
-        i->pcursor->GetKey(i->keyTmp);
+        CoinEntry entry(&i->keyTmp.second);
+        i->pcursor->GetKey(entry);
+        i->keyTmp.first = entry.key;
     } else {
         i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
     }
     return i;
 }
 
-bool CCoinsViewDBCursor::GetKey(uint256 &key) const
+bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
+    if (keyTmp.first == DB_COIN) {
         key = keyTmp.second;
         return true;
     }
     return false;
 }
 
-bool CCoinsViewDBCursor::GetValue(CCoins &coins) const
+bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coins);
+    return pcursor->GetValue(coin);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
@@ -128,14 +340,18 @@ unsigned int CCoinsViewDBCursor::GetValueSize() const
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    return keyTmp.first == DB_COIN;
 }
 
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp))
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else {
+        keyTmp.first = entry.key;
+    }
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -147,9 +363,19 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    // Any flat copy of the block index is out of date from here on
+    batch.Erase(DB_FLAT_INDEX_STAMP);
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadFlatIndexStamp(uint64_t &nStamp) {
+    return Read(DB_FLAT_INDEX_STAMP, nStamp);
+}
+
+bool CBlockTreeDB::WriteFlatIndexStamp(uint64_t nStamp) {
+    return Write(DB_FLAT_INDEX_STAMP, nStamp, true);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
@@ -217,3 +443,173 @@ bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)
 
     return true;
 }
+
+namespace {
+
+//! Legacy class to deserialize pre-pertxout database entries without reindex.
+class CCoins
+{
+public:
+    //! whether transaction is a coinbase
+    bool fCoinBase;
+
+    //! unspent transaction outputs; spent outputs are .IsNull(); spent outputs at the end of the array are dropped
+    std::vector<CTxOut> vout;
+
+    //! at which height this transaction was included in the active block chain
+    int nHeight;
+
+    //! empty constructor
+    CCoins() : fCoinBase(false), vout(0), nHeight(0) { }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nCode = 0;
+        // version
+        int nVersionDummy;
+        ::Unserialize(s, VARINT(nVersionDummy));
+        // header code
+        ::Unserialize(s, VARINT(nCode));
+        fCoinBase = nCode & 1;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 2) != 0;
+        vAvail[1] = (nCode & 4) != 0;
+        unsigned int nMaskCode = (nCode / 8) + ((nCode & 6) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])));
+        }
+        // coinbase height
+        ::Unserialize(s, VARINT(nHeight));
+    }
+};
+
+}
+
+/** Upgrade the database from older formats.
+ *
+ * Currently implemented: from the per-tx utxo model (up to 1.14.x) to per-txout.
+ */
+bool CCoinsViewDB::Upgrade() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_COINS, uint256()));
+    if (!pcursor->Valid()) {
+        return true;
+    }
+
+    int64_t count = 0;
+    LogPrintf("Upgrading utxo-set database...\n");
+    LogPrintf("[0%%]...");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    int reportDone = 0;
+    std::pair<unsigned char, uint256> key;
+    std::pair<unsigned char, uint256> prev_key = std::make_pair(DB_COINS, uint256());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        if (pcursor->GetKey(key) && key.first == DB_COINS) {
+            if (count++ % 256 == 0) {
+                uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
+                int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+                uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone);
+                if (reportDone < percentageDone/10) {
+                    // report max. every 10% step
+                    LogPrintf("[%d%%]...", percentageDone);
+                    reportDone = percentageDone/10;
+                }
+            }
+            CCoins old_coins;
+            if (!pcursor->GetValue(old_coins)) {
+                return error("%s: cannot parse CCoins record", __func__);
+            }
+            COutPoint outpoint(key.second, 0);
+            for (size_t i = 0; i < old_coins.vout.size(); ++i) {
+                if (!old_coins.vout[i].IsNull() && !old_coins.vout[i].scriptPubKey.IsUnspendable()) {
+                    Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase);
+                    outpoint.n = i;
+                    CoinEntry entry(&outpoint);
+                    batch.Write(entry, newcoin);
+                }
+            }
+            batch.Erase(key);
+            if (batch.SizeEstimate() > batch_size) {
+                db.WriteBatch(batch);
+                batch.Clear();
+                db.CompactRange(prev_key, key);
+                prev_key = key;
+            }
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+    db.WriteBatch(batch);
+    db.CompactRange(prev_key, key);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested();
+}
+
+bool CCoinsViewDB::EraseCoins() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COIN);
+
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    COutPoint outpoint;
+    CoinEntry entry(&outpoint);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN)
+            break;
+        batch.Erase(entry);
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    return db.WriteBatch(batch);
+}
+
+bool CCoinsViewDB::WriteCoins(const std::vector<std::pair<COutPoint, Coin> >& vCoins) {
+    CDBBatch batch(db);
+    for (const auto& coin : vCoins) {
+        CoinEntry entry(&coin.first);
+        batch.Write(entry, coin.second);
+    }
+    LogPrint("coindb", "Writing %u transaction outputs to coin database...\n", (unsigned int)vCoins.size());
+    return db.WriteBatch(batch);
+}
+
+CPoWCacheDB::CPoWCacheDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "powcache", nCacheSize, fMemory, fWipe) {
+}
+
+bool CPoWCacheDB::ReadPoWHash(const uint256 &hash, uint256 &hashPoW) {
+    return Read(std::make_pair(DB_POW_HASH, hash), hashPoW);
+}
+
+bool CPoWCacheDB::WritePoWHashes(const std::vector<std::pair<uint256, uint256> > &list) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<uint256,uint256> >::const_iterator it=list.begin(); it!=list.end(); it++)
+        batch.Write(std::make_pair(DB_POW_HASH, it->first), it->second);
+    return WriteBatch(batch);
+}
@@ -16,6 +16,9 @@
 #include <vector>
 #include <functional>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CBlockIndex;
 class CCoinsViewDBCursor;
 class uint256;
@@ -40,6 +43,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the proof of work hash cache DB (MiB)
+static const int64_t nMaxPoWCacheDBCache = 2;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -71,14 +76,75 @@ class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    //! UTXO set hashes to write along with their best block
+    mutable boost::mutex mutexUTXOSetHash;
+    std::map<uint256, CUTXOSetHash> mapUTXOSetHash;
+
+    void WriteUTXOSetHash(CDBBatch &batch, const uint256 &hashBlock);
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+
+    //! Write the dirty entries of mapCoins without modifying it, so it can be read meanwhile.
+    bool WriteCoinsMap(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! Attempt to update from an older database format. Returns whether an error occurred.
+    bool Upgrade();
+    //! Remove every coin from the database, leaving the best block untouched.
+    bool EraseCoins();
+    //! Write coins straight to the database in a single batch, bypassing any cache.
+    bool WriteCoins(const std::vector<std::pair<COutPoint, Coin> >& vCoins);
+    //! Have the hash of the UTXO set as of hashBlock written when hashBlock is written as the best block.
+    void SetUTXOSetHash(const uint256 &hashBlock, const CUTXOSetHash &hash);
+    //! Read the hash of the UTXO set as of the best block, if it was written.
+    bool GetUTXOSetHash(CUTXOSetHash &hash) const;
+};
+
+/**
+ * CCoinsView layer that lets the coins cache be flushed without waiting for
+ * the coin database.
+ *
+ * While a flusher thread is running Thread(), BatchWrite hands the dirty
+ * entries to it and returns. Until they are written they stay readable here,
+ * as a frozen layer over the database. A BatchWrite arriving while the
+ * previous one is still being written waits for it. Without a running
+ * thread, writes go straight through.
+ */
+class CCoinsViewFlusher : public CCoinsViewBacked
+{
+private:
+    CCoinsViewDB *pdb;
+
+    mutable boost::mutex mutex;
+    mutable boost::condition_variable cond;
+    //! Entries being written; not modified while fPending is set.
+    CCoinsMap mapFrozen;
+    uint256 hashFrozen;
+    size_t nFrozenUsage;
+    bool fPending;
+    bool fRunning;
+    bool fFailed;
+
+public:
+    CCoinsViewFlusher(CCoinsView *viewIn, CCoinsViewDB *dbIn);
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    CCoinsViewCursor *Cursor() const;
+
+    //! Wait until the write in progress, if any, is on disk. Returns false if a write failed.
+    bool Sync() const;
+    //! Memory used by the entries that are still being written.
+    size_t DynamicMemoryUsage() const;
+    //! Write the entries handed over by BatchWrite, until interrupted.
+    void Thread();
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -87,8 +153,8 @@ class CCoinsViewDBCursor: public CCoinsViewCursor
 public:
     ~CCoinsViewDBCursor() {}
 
-    bool GetKey(uint256 &key) const;
-    bool GetValue(CCoins &coins) const;
+    bool GetKey(COutPoint &key) const;
+    bool GetValue(Coin &coin) const;
     unsigned int GetValueSize() const;
 
     bool Valid() const;
@@ -98,7 +164,7 @@ private:
     CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
         CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
     std::unique_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    std::pair<char, COutPoint> keyTmp;
 
     friend class CCoinsViewDB;
 };
@@ -122,6 +188,28 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! Stamp of the flat block index file matching the database, if any (see blockindexfile.h)
+    bool ReadFlatIndexStamp(uint64_t &nStamp);
+    bool WriteFlatIndexStamp(uint64_t nStamp);
+};
+
+/**
+ * Access to the proof of work hash cache (blocks/powcache/).
+ *
+ * Maps the hash of a header that carries proof of work (a block header, or
+ * the parent block of an auxpow) to its scrypt hash.  Entries are keyed by
+ * content and never go stale, so the cache is kept across -reindex.
+ */
+class CPoWCacheDB : public CDBWrapper
+{
+public:
+    CPoWCacheDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CPoWCacheDB(const CPoWCacheDB&);
+    void operator=(const CPoWCacheDB&);
+public:
+    bool ReadPoWHash(const uint256 &hash, uint256 &hashPoW);
+    bool WritePoWHashes(const std::vector<std::pair<uint256, uint256> > &list);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -7,12 +7,15 @@
 #include "validation.h"
 
 #include "arith_uint256.h"
+#include "blockindexfile.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/scrypt.h"
+#include "cuckoocache.h"
 #include "dogecoin.h"
 #include "dogecoin-fees.h"
 #include "fs.h"
@@ -42,6 +45,7 @@
 #include "warnings.h"
 
 #include <atomic>
+#include <deque>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -66,10 +70,13 @@ CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+bool fDeferSigChecks = DEFAULT_DEFERRED_SIG_CHECKS;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = false;
+bool fFlatBlockIndex = DEFAULT_FLATBLOCKINDEX;
 bool fHavePruned = false;
+bool fHaveSnapshot = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
@@ -183,6 +190,9 @@ namespace {
 
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
+
+    /** Storage of the block index entries loaded from the flat block index file. */
+    CBlockIndexArena blockindexarena;
 } // anon namespace
 
 /* Use this class to start tracking transactions that are removed from the
@@ -240,8 +250,15 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+CCoinsViewDB *pcoinsdbview = NULL;
+CCoinsViewFlusher *pcoinsflusher = NULL;
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CPoWCacheDB *ppowcache = NULL;
+
+/** Rolling hash of the UTXO set as of pcoinsTip's best block, if fUTXOSetHashTip. Guarded by cs_main. */
+static CUTXOSetHash utxoSetHashTip;
+static bool fUTXOSetHashTip = false;
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -429,15 +446,15 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins)) {
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -493,7 +510,9 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& in
     unsigned int nSigOps = 0;
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        const CTxOut &prevout = inputs.GetOutputFor(tx.vin[i]);
+        const Coin& coin = inputs.AccessCoin(tx.vin[i].prevout);
+        assert(!coin.IsSpent());
+        const CTxOut &prevout = coin.out;
         if (prevout.scriptPubKey.IsPayToScriptHash())
             nSigOps += prevout.scriptPubKey.GetSigOpCount(tx.vin[i].scriptSig);
     }
@@ -513,7 +532,9 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        const CTxOut &prevout = inputs.GetOutputFor(tx.vin[i]);
+        const Coin& coin = inputs.AccessCoin(tx.vin[i].prevout);
+        assert(!coin.IsSpent());
+        const CTxOut &prevout = coin.out;
         nSigOps += CountWitnessSigOps(tx.vin[i].scriptSig, prevout.scriptPubKey, &tx.vin[i].scriptWitness, flags);
     }
     return nSigOps;
@@ -577,9 +598,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+    BOOST_FOREACH(const COutPoint& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -604,10 +625,51 @@ static bool IsCurrentForFeeEstimation()
     return true;
 }
 
-bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
-                              bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache)
+/**
+ * A transaction on its way into the mempool: what the checks made under
+ * cs_main found out about it, for the script checks, which do not need
+ * cs_main, and for adding it to the mempool afterwards. The mempool
+ * iterators are only valid as long as the mempool does not change.
+ */
+struct CMemPoolCandidate
+{
+    CTransactionRef ptx;
+    // The coins the transaction spends, detached from the UTXO set
+    CCoinsView dummy;
+    CCoinsViewCache view;
+    std::unique_ptr<CTxMemPoolEntry> pentry;
+    std::set<uint256> setConflicts;
+    CTxMemPool::setEntries setAncestors;
+    CTxMemPool::setEntries allConflicting;
+    CAmount nModifiedFees;
+    CAmount nConflictingFees;
+    size_t nConflictingSize;
+    unsigned int scriptVerifyFlags;
+    unsigned int currentBlockScriptVerifyFlags;
+    // Whether the script execution cache has the scripts passing with
+    // currentBlockScriptVerifyFlags
+    bool fScriptsCached;
+
+    explicit CMemPoolCandidate(const CTransactionRef& ptxIn) :
+        ptx(ptxIn), view(&dummy), nModifiedFees(0), nConflictingFees(0), nConflictingSize(0),
+        scriptVerifyFlags(0), currentBlockScriptVerifyFlags(0), fScriptsCached(false) {}
+};
+
+static bool CheckInputScripts(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, CDeferredSigChecks *pdeferred);
+static bool IsScriptExecutionCached(const CTransaction& tx, unsigned int flags);
+static void AddScriptExecutionCache(const CTransaction& tx, unsigned int flags);
+static void CheckMemPoolScriptsParallel(std::vector<std::unique_ptr<CMemPoolCandidate> >& vCandidates, std::vector<std::unique_ptr<PrecomputedTransactionData> >& vTxData, const std::vector<CValidationState*>& vpState);
+
+/**
+ * Run all checks of a mempool candidate except for its scripts. Leaves the
+ * coins it spends in ws.view. With fRecheck, the transaction was checked
+ * before and is not charged to the free transaction rate limiter again.
+ */
+static bool PreChecks(CTxMemPool& pool, CValidationState& state, CMemPoolCandidate& ws, bool fLimitFree,
+                      bool* pfMissingInputs, int64_t nAcceptTime, const CAmount& nAbsurdFee,
+                      std::vector<COutPoint>& coins_to_uncache, bool fRecheck)
 {
+    const CTransactionRef& ptx = ws.ptx;
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
@@ -643,7 +705,6 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-in-mempool");
 
     // Check for conflicts with in-memory transactions
-    std::set<uint256> setConflicts;
     {
     LOCK(pool.cs); // protect pool.mapNextTx
     BOOST_FOREACH(const CTxIn &txin, tx.vin)
@@ -652,7 +713,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         if (itConflicting != pool.mapNextTx.end())
         {
             const CTransaction *ptxConflicting = itConflicting->second;
-            if (!setConflicts.count(ptxConflicting->GetHash()))
+            if (!ws.setConflicts.count(ptxConflicting->GetHash()))
             {
                 // Allow opt-out of transaction replacement by setting
                 // nSequence >= maxint-1 on all inputs.
@@ -681,357 +742,385 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
                 if (fReplacementOptOut)
                     return state.Invalid(false, REJECT_CONFLICT, "txn-mempool-conflict");
 
-                setConflicts.insert(ptxConflicting->GetHash());
+                ws.setConflicts.insert(ptxConflicting->GetHash());
             }
         }
     }
     }
 
+    CAmount nValueIn = 0;
+    LockPoints lp;
     {
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
-
-        CAmount nValueIn = 0;
-        LockPoints lp;
-        {
-        LOCK(pool.cs);
-        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
-        view.SetBackend(viewMemPool);
-
-        // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
-        }
-
-        // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
-        BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
-                if (pfMissingInputs)
-                    *pfMissingInputs = true;
-                return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
-            }
+    LOCK(pool.cs);
+    CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+    ws.view.SetBackend(viewMemPool);
+
+    // do all inputs exist?
+    BOOST_FOREACH(const CTxIn txin, tx.vin) {
+        if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+            coins_to_uncache.push_back(txin.prevout);
         }
-
-        // are the actual inputs available?
-        if (!view.HaveInputs(tx))
-            return state.Invalid(false, REJECT_DUPLICATE, "bad-txns-inputs-spent");
-
-        // Bring the best block into scope
-        view.GetBestBlock();
-
-        nValueIn = view.GetValueIn(tx);
-
-        // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
-        view.SetBackend(dummy);
-
-        // Only accept BIP68 sequence locked transactions that can be mined in the next
-        // block; we don't want our mempool filled up with transactions that can't
-        // be mined yet.
-        // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
-        // CoinsViewCache instead of create its own
-        if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
-            return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
+        if (!ws.view.HaveCoin(txin.prevout)) {
+            // Are inputs missing because we already have the tx?
+            for (size_t out = 0; out < tx.vout.size(); out++) {
+                // Optimistically just do efficient check of cache for outputs
+                if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out))) {
+                    return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+                }
+            }
+            // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
+            if (pfMissingInputs) {
+                *pfMissingInputs = true;
+            }
+            return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
         }
+    }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (fRequireStandard && !AreInputsStandard(tx, view))
-            return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
-
-        // Check for non-standard witness in P2WSH
-        if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-witness-nonstandard", true);
+    // are the actual inputs available?
+    if (!ws.view.HaveInputs(tx))
+        return state.Invalid(false, REJECT_DUPLICATE, "bad-txns-inputs-spent");
 
-        int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+    // Bring the best block into scope
+    ws.view.GetBestBlock();
 
-        CAmount nValueOut = tx.GetValueOut();
-        CAmount nFees = nValueIn-nValueOut;
-        // nModifiedFees includes any fee deltas from PrioritiseTransaction
-        CAmount nModifiedFees = nFees;
-        double nPriorityDummy = 0;
-        pool.ApplyDeltas(hash, nPriorityDummy, nModifiedFees);
+    nValueIn = ws.view.GetValueIn(tx);
 
-        CAmount inChainInputValue;
-        double dPriority = view.GetPriority(tx, chainActive.Height(), inChainInputValue);
+    // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
+    ws.view.SetBackend(ws.dummy);
 
-        // Keep track of transactions that spend a coinbase, which we re-scan
-        // during reorgs to ensure COINBASE_MATURITY is still met.
-        bool fSpendsCoinbase = false;
-        BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase()) {
-                fSpendsCoinbase = true;
-                break;
-            }
+    // Only accept BIP68 sequence locked transactions that can be mined in the next
+    // block; we don't want our mempool filled up with transactions that can't
+    // be mined yet.
+    // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
+    // CoinsViewCache instead of create its own
+    if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+        return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
+    }
+
+    // Check for non-standard pay-to-script-hash in inputs
+    if (fRequireStandard && !AreInputsStandard(tx, ws.view))
+        return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+
+    // Check for non-standard witness in P2WSH
+    if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, ws.view))
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-witness-nonstandard", true);
+
+    int64_t nSigOpsCost = GetTransactionSigOpCost(tx, ws.view, STANDARD_SCRIPT_VERIFY_FLAGS);
+
+    CAmount nValueOut = tx.GetValueOut();
+    CAmount nFees = nValueIn-nValueOut;
+    // nModifiedFees includes any fee deltas from PrioritiseTransaction
+    ws.nModifiedFees = nFees;
+    double nPriorityDummy = 0;
+    pool.ApplyDeltas(hash, nPriorityDummy, ws.nModifiedFees);
+
+    CAmount inChainInputValue;
+    double dPriority = ws.view.GetPriority(tx, chainActive.Height(), inChainInputValue);
+
+    // Keep track of transactions that spend a coinbase, which we re-scan
+    // during reorgs to ensure COINBASE_MATURITY is still met.
+    bool fSpendsCoinbase = false;
+    BOOST_FOREACH(const CTxIn &txin, tx.vin) {
+        const Coin &coin = ws.view.AccessCoin(txin.prevout);
+        if (coin.IsCoinBase()) {
+            fSpendsCoinbase = true;
+            break;
         }
+    }
 
-        CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, dPriority, chainActive.Height(),
-                              inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp);
-        unsigned int nSize = entry.GetTxSize();
+    ws.pentry.reset(new CTxMemPoolEntry(ptx, nFees, nAcceptTime, dPriority, chainActive.Height(),
+                                        inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp));
+    unsigned int nSize = ws.pentry->GetTxSize();
 
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine. Since the coinbase transaction
-        // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
-        // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
-        // merely non-standard transaction.
-        if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
-                strprintf("%d", nSigOpsCost));
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine. Since the coinbase transaction
+    // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
+    // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
+    // merely non-standard transaction.
+    if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
+            strprintf("%d", nSigOpsCost));
 
-        CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
-        if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nModifiedFees, mempoolRejectFee));
-        } else if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) && nModifiedFees < ::minRelayTxFeeRate.GetFee(nSize) && !AllowFree(entry.GetPriority(chainActive.Height() + 1))) {
-            // Require that free transactions have sufficient priority to be mined in the next block.
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
-        }
+    CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+    if (mempoolRejectFee > 0 && ws.nModifiedFees < mempoolRejectFee) {
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", ws.nModifiedFees, mempoolRejectFee));
+    } else if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) && ws.nModifiedFees < ::minRelayTxFeeRate.GetFee(nSize) && !AllowFree(ws.pentry->GetPriority(chainActive.Height() + 1))) {
+        // Require that free transactions have sufficient priority to be mined in the next block.
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
+    }
 
-        // Continuously rate-limit free (really, very-low-fee) transactions
-        // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
-        // be annoying or make others' transactions take longer to confirm.
-        if (fLimitFree && nModifiedFees < GetDogecoinMinRelayFee(tx, nSize, !fLimitFree))
-        {
-            static CCriticalSection csFreeLimiter;
-            static double dFreeCount;
-            static int64_t nLastTime;
-            int64_t nNow = GetTime();
-
-            LOCK(csFreeLimiter);
-
-            // Use an exponentially decaying ~10-minute window:
-            dFreeCount *= pow(1.0 - 1.0/600.0, (double)(nNow - nLastTime));
-            nLastTime = nNow;
-            // -limitfreerelay unit is thousand-bytes-per-minute
-            // At default rate it would take over a month to fill 1GB
-            if (dFreeCount + nSize >= GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) * 10 * 1000)
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "rate limited free transaction");
-            LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount+nSize);
-            dFreeCount += nSize;
-        }
-
-        if (nAbsurdFee && nFees > nAbsurdFee)
-            return state.Invalid(false,
-                REJECT_HIGHFEE, "absurdly-high-fee",
-                strprintf("%d > %d", nFees, nAbsurdFee));
-
-        // Calculate in-mempool ancestors, up to a limit.
-        CTxMemPool::setEntries setAncestors;
-        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
-        size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
-        size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
-        size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
-        std::string errString;
-        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
-            return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
-        }
-
-        // A transaction that spends outputs that would be replaced by it is invalid. Now
-        // that we have the set of all ancestors we can detect this
-        // pathological case by making sure setConflicts and setAncestors don't
-        // intersect.
-        BOOST_FOREACH(CTxMemPool::txiter ancestorIt, setAncestors)
+    // Continuously rate-limit free (really, very-low-fee) transactions
+    // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
+    // be annoying or make others' transactions take longer to confirm.
+    if (fLimitFree && !fRecheck && ws.nModifiedFees < GetDogecoinMinRelayFee(tx, nSize, !fLimitFree))
+    {
+        static CCriticalSection csFreeLimiter;
+        static double dFreeCount;
+        static int64_t nLastTime;
+        int64_t nNow = GetTime();
+
+        LOCK(csFreeLimiter);
+
+        // Use an exponentially decaying ~10-minute window:
+        dFreeCount *= pow(1.0 - 1.0/600.0, (double)(nNow - nLastTime));
+        nLastTime = nNow;
+        // -limitfreerelay unit is thousand-bytes-per-minute
+        // At default rate it would take over a month to fill 1GB
+        if (dFreeCount + nSize >= GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) * 10 * 1000)
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "rate limited free transaction");
+        LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount+nSize);
+        dFreeCount += nSize;
+    }
+
+    if (nAbsurdFee && nFees > nAbsurdFee)
+        return state.Invalid(false,
+            REJECT_HIGHFEE, "absurdly-high-fee",
+            strprintf("%d > %d", nFees, nAbsurdFee));
+
+    // Calculate in-mempool ancestors, up to a limit.
+    size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
+    size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
+    std::string errString;
+    if (!pool.CalculateMemPoolAncestors(*ws.pentry, ws.setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
+    }
+
+    // A transaction that spends outputs that would be replaced by it is invalid. Now
+    // that we have the set of all ancestors we can detect this
+    // pathological case by making sure setConflicts and setAncestors don't
+    // intersect.
+    BOOST_FOREACH(CTxMemPool::txiter ancestorIt, ws.setAncestors)
+    {
+        const uint256 &hashAncestor = ancestorIt->GetTx().GetHash();
+        if (ws.setConflicts.count(hashAncestor))
         {
-            const uint256 &hashAncestor = ancestorIt->GetTx().GetHash();
-            if (setConflicts.count(hashAncestor))
-            {
-                return state.DoS(10, false,
-                                 REJECT_INVALID, "bad-txns-spends-conflicting-tx", false,
-                                 strprintf("%s spends conflicting transaction %s",
-                                           hash.ToString(),
-                                           hashAncestor.ToString()));
-            }
+            return state.DoS(10, false,
+                             REJECT_INVALID, "bad-txns-spends-conflicting-tx", false,
+                             strprintf("%s spends conflicting transaction %s",
+                                       hash.ToString(),
+                                       hashAncestor.ToString()));
         }
+    }
 
-        // Check if it's economically rational to mine this transaction rather
-        // than the ones it replaces.
-        CAmount nConflictingFees = 0;
-        size_t nConflictingSize = 0;
-        uint64_t nConflictingCount = 0;
-        CTxMemPool::setEntries allConflicting;
+    // Check if it's economically rational to mine this transaction rather
+    // than the ones it replaces.
+    uint64_t nConflictingCount = 0;
 
-        // If we don't hold the lock allConflicting might be incomplete; the
-        // subsequent RemoveStaged() and addUnchecked() calls don't guarantee
-        // mempool consistency for us.
-        LOCK(pool.cs);
-        const bool fReplacementTransaction = setConflicts.size();
-        if (fReplacementTransaction)
+    // If we don't hold the lock allConflicting might be incomplete. The
+    // mempool only changes under cs_main, so it stays valid for
+    // AddMemPoolCandidate as long as cs_main is not released in between.
+    LOCK(pool.cs);
+    if (!ws.setConflicts.empty())
+    {
+        CFeeRate newFeeRate(ws.nModifiedFees, nSize);
+        std::set<uint256> setConflictsParents;
+        const int maxDescendantsToVisit = 100;
+        CTxMemPool::setEntries setIterConflicting;
+        BOOST_FOREACH(const uint256 &hashConflicting, ws.setConflicts)
         {
-            CFeeRate newFeeRate(nModifiedFees, nSize);
-            std::set<uint256> setConflictsParents;
-            const int maxDescendantsToVisit = 100;
-            CTxMemPool::setEntries setIterConflicting;
-            BOOST_FOREACH(const uint256 &hashConflicting, setConflicts)
-            {
-                CTxMemPool::txiter mi = pool.mapTx.find(hashConflicting);
-                if (mi == pool.mapTx.end())
-                    continue;
-
-                // Save these to avoid repeated lookups
-                setIterConflicting.insert(mi);
-
-                // Don't allow the replacement to reduce the feerate of the
-                // mempool.
-                //
-                // We usually don't want to accept replacements with lower
-                // feerates than what they replaced as that would lower the
-                // feerate of the next block. Requiring that the feerate always
-                // be increased is also an easy-to-reason about way to prevent
-                // DoS attacks via replacements.
-                //
-                // The mining code doesn't (currently) take children into
-                // account (CPFP) so we only consider the feerates of
-                // transactions being directly replaced, not their indirect
-                // descendants. While that does mean high feerate children are
-                // ignored when deciding whether or not to replace, we do
-                // require the replacement to pay more overall fees too,
-                // mitigating most cases.
-                CFeeRate oldFeeRate(mi->GetModifiedFee(), mi->GetTxSize());
-                if (newFeeRate <= oldFeeRate)
-                {
-                    return state.DoS(0, false,
-                            REJECT_INSUFFICIENTFEE, "insufficient fee", false,
-                            strprintf("rejecting replacement %s; new feerate %s <= old feerate %s",
-                                  hash.ToString(),
-                                  newFeeRate.ToString(),
-                                  oldFeeRate.ToString()));
-                }
-
-                BOOST_FOREACH(const CTxIn &txin, mi->GetTx().vin)
-                {
-                    setConflictsParents.insert(txin.prevout.hash);
-                }
+            CTxMemPool::txiter mi = pool.mapTx.find(hashConflicting);
+            if (mi == pool.mapTx.end())
+                continue;
 
-                nConflictingCount += mi->GetCountWithDescendants();
-            }
-            // This potentially overestimates the number of actual descendants
-            // but we just want to be conservative to avoid doing too much
-            // work.
-            if (nConflictingCount <= maxDescendantsToVisit) {
-                // If not too many to replace, then calculate the set of
-                // transactions that would have to be evicted
-                BOOST_FOREACH(CTxMemPool::txiter it, setIterConflicting) {
-                    pool.CalculateDescendants(it, allConflicting);
-                }
-                BOOST_FOREACH(CTxMemPool::txiter it, allConflicting) {
-                    nConflictingFees += it->GetModifiedFee();
-                    nConflictingSize += it->GetTxSize();
-                }
-            } else {
+            // Save these to avoid repeated lookups
+            setIterConflicting.insert(mi);
+
+            // Don't allow the replacement to reduce the feerate of the
+            // mempool.
+            //
+            // We usually don't want to accept replacements with lower
+            // feerates than what they replaced as that would lower the
+            // feerate of the next block. Requiring that the feerate always
+            // be increased is also an easy-to-reason about way to prevent
+            // DoS attacks via replacements.
+            //
+            // The mining code doesn't (currently) take children into
+            // account (CPFP) so we only consider the feerates of
+            // transactions being directly replaced, not their indirect
+            // descendants. While that does mean high feerate children are
+            // ignored when deciding whether or not to replace, we do
+            // require the replacement to pay more overall fees too,
+            // mitigating most cases.
+            CFeeRate oldFeeRate(mi->GetModifiedFee(), mi->GetTxSize());
+            if (newFeeRate <= oldFeeRate)
+            {
                 return state.DoS(0, false,
-                        REJECT_NONSTANDARD, "too many potential replacements", false,
-                        strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
-                            hash.ToString(),
-                            nConflictingCount,
-                            maxDescendantsToVisit));
+                        REJECT_INSUFFICIENTFEE, "insufficient fee", false,
+                        strprintf("rejecting replacement %s; new feerate %s <= old feerate %s",
+                              hash.ToString(),
+                              newFeeRate.ToString(),
+                              oldFeeRate.ToString()));
             }
 
-            for (unsigned int j = 0; j < tx.vin.size(); j++)
+            BOOST_FOREACH(const CTxIn &txin, mi->GetTx().vin)
             {
-                // We don't want to accept replacements that require low
-                // feerate junk to be mined first. Ideally we'd keep track of
-                // the ancestor feerates and make the decision based on that,
-                // but for now requiring all new inputs to be confirmed works.
-                if (!setConflictsParents.count(tx.vin[j].prevout.hash))
-                {
-                    // Rather than check the UTXO set - potentially expensive -
-                    // it's cheaper to just check if the new input refers to a
-                    // tx that's in the mempool.
-                    if (pool.mapTx.find(tx.vin[j].prevout.hash) != pool.mapTx.end())
-                        return state.DoS(0, false,
-                                         REJECT_NONSTANDARD, "replacement-adds-unconfirmed", false,
-                                         strprintf("replacement %s adds unconfirmed input, idx %d",
-                                                  hash.ToString(), j));
-                }
+                setConflictsParents.insert(txin.prevout.hash);
             }
 
-            // The replacement must pay greater fees than the transactions it
-            // replaces - if we did the bandwidth used by those conflicting
-            // transactions would not be paid for.
-            if (nModifiedFees < nConflictingFees)
-            {
-                return state.DoS(0, false,
-                                 REJECT_INSUFFICIENTFEE, "insufficient fee", false,
-                                 strprintf("rejecting replacement %s, less fees than conflicting txs; %s < %s",
-                                          hash.ToString(), FormatMoney(nModifiedFees), FormatMoney(nConflictingFees)));
+            nConflictingCount += mi->GetCountWithDescendants();
+        }
+        // This potentially overestimates the number of actual descendants
+        // but we just want to be conservative to avoid doing too much
+        // work.
+        if (nConflictingCount <= maxDescendantsToVisit) {
+            // If not too many to replace, then calculate the set of
+            // transactions that would have to be evicted
+            BOOST_FOREACH(CTxMemPool::txiter it, setIterConflicting) {
+                pool.CalculateDescendants(it, ws.allConflicting);
             }
+            BOOST_FOREACH(CTxMemPool::txiter it, ws.allConflicting) {
+                ws.nConflictingFees += it->GetModifiedFee();
+                ws.nConflictingSize += it->GetTxSize();
+            }
+        } else {
+            return state.DoS(0, false,
+                    REJECT_NONSTANDARD, "too many potential replacements", false,
+                    strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
+                        hash.ToString(),
+                        nConflictingCount,
+                        maxDescendantsToVisit));
+        }
 
-            // Finally in addition to paying more fees than the conflicts the
-            // new transaction must pay for its own bandwidth.
-            CAmount nDeltaFees = nModifiedFees - nConflictingFees;
-            if (nDeltaFees < ::incrementalRelayFee.GetFee(nSize))
+        for (unsigned int j = 0; j < tx.vin.size(); j++)
+        {
+            // We don't want to accept replacements that require low
+            // feerate junk to be mined first. Ideally we'd keep track of
+            // the ancestor feerates and make the decision based on that,
+            // but for now requiring all new inputs to be confirmed works.
+            if (!setConflictsParents.count(tx.vin[j].prevout.hash))
             {
-                return state.DoS(0, false,
-                        REJECT_INSUFFICIENTFEE, "insufficient fee", false,
-                        strprintf("rejecting replacement %s, not enough additional fees to relay; %s < %s",
-                              hash.ToString(),
-                              FormatMoney(nDeltaFees),
-                              FormatMoney(::incrementalRelayFee.GetFee(nSize))));
+                // Rather than check the UTXO set - potentially expensive -
+                // it's cheaper to just check if the new input refers to a
+                // tx that's in the mempool.
+                if (pool.mapTx.find(tx.vin[j].prevout.hash) != pool.mapTx.end())
+                    return state.DoS(0, false,
+                                     REJECT_NONSTANDARD, "replacement-adds-unconfirmed", false,
+                                     strprintf("replacement %s adds unconfirmed input, idx %d",
+                                              hash.ToString(), j));
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!Params().RequireStandard()) {
-            scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+        // The replacement must pay greater fees than the transactions it
+        // replaces - if we did the bandwidth used by those conflicting
+        // transactions would not be paid for.
+        if (ws.nModifiedFees < ws.nConflictingFees)
+        {
+            return state.DoS(0, false,
+                             REJECT_INSUFFICIENTFEE, "insufficient fee", false,
+                             strprintf("rejecting replacement %s, less fees than conflicting txs; %s < %s",
+                                      hash.ToString(), FormatMoney(ws.nModifiedFees), FormatMoney(ws.nConflictingFees)));
         }
 
-        // Check against previous transactions
-        // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
-            // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
-            // need to turn both off, and compare against just turning off CLEANSTACK
-            // to see if the failure is specifically due to witness validation.
-            CValidationState stateDummy; // Want reported failures to be from first CheckInputs
-            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
-                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
-                // Only the witness is missing, so the transaction itself may be fine.
-                state.SetCorruptionPossible();
-            }
-            return false; // state filled in by CheckInputs
-        }
-
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks, however allowing such transactions into the mempool
-        // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        // Finally in addition to paying more fees than the conflicts the
+        // new transaction must pay for its own bandwidth.
+        CAmount nDeltaFees = ws.nModifiedFees - ws.nConflictingFees;
+        if (nDeltaFees < ::incrementalRelayFee.GetFee(nSize))
         {
-            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
-                __func__, hash.ToString(), FormatStateMessage(state));
+            return state.DoS(0, false,
+                    REJECT_INSUFFICIENTFEE, "insufficient fee", false,
+                    strprintf("rejecting replacement %s, not enough additional fees to relay; %s < %s",
+                          hash.ToString(),
+                          FormatMoney(nDeltaFees),
+                          FormatMoney(::incrementalRelayFee.GetFee(nSize))));
         }
+    }
+
+    ws.scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard()) {
+        ws.scriptVerifyFlags = GetArg("-promiscuousmempoolflags", ws.scriptVerifyFlags);
+    }
+    ws.currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), chainActive.Height() + 1, Params());
+    ws.fScriptsCached = IsScriptExecutionCached(tx, ws.currentBlockScriptVerifyFlags);
+
+    // The inexpensive input checks, which need cs_main for the spend height
+    if (!Consensus::CheckTxInputs(Params(), tx, state, ws.view, GetSpendHeight(ws.view)))
+        return false;
+
+    return true;
+}
+
+/**
+ * Check the scripts of a mempool candidate against the coins in ws.view.
+ * fStandardChecked skips the check with the standard flags, when it was
+ * already done elsewhere. Does not need cs_main.
+ */
+static bool CheckMemPoolScripts(const CMemPoolCandidate& ws, CValidationState& state, PrecomputedTransactionData& txdata, bool fStandardChecked = false)
+{
+    const CTransaction& tx = *ws.ptx;
+
+    // Check against previous transactions
+    // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+    if (!fStandardChecked && !CheckInputScripts(tx, state, ws.view, ws.scriptVerifyFlags, true, txdata, NULL, NULL)) {
+        // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
+        // need to turn both off, and compare against just turning off CLEANSTACK
+        // to see if the failure is specifically due to witness validation.
+        CValidationState stateDummy; // Want reported failures to be from first CheckInputScripts
+        if (!tx.HasWitness() && CheckInputScripts(tx, stateDummy, ws.view, ws.scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata, NULL, NULL) &&
+            !CheckInputScripts(tx, stateDummy, ws.view, ws.scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata, NULL, NULL)) {
+            // Only the witness is missing, so the transaction itself may be fine.
+            state.SetCorruptionPossible();
+        }
+        return false; // state filled in by CheckInputScripts
+    }
+
+    // Check again against the script verification flags the next block
+    // will be checked with, which include the consensus-critical mandatory
+    // ones, in case of bugs in the standard flags that cause transactions
+    // to pass as valid when they're actually invalid. For instance the
+    // STRICTENC flag was incorrectly allowing certain CHECKSIG NOT scripts
+    // to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks, however allowing such transactions into the mempool
+    // can be exploited as a DoS attack.
+    if (!ws.fScriptsCached && !CheckInputScripts(tx, state, ws.view, ws.currentBlockScriptVerifyFlags, true, txdata, NULL, NULL))
+    {
+        return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
+            __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+    }
+
+    return true;
+}
+
+/** Add a mempool candidate which passed all checks, with the mempool unchanged since PreChecks. */
+static bool AddMemPoolCandidate(CTxMemPool& pool, CValidationState& state, CMemPoolCandidate& ws,
+                                std::list<CTransactionRef>* plTxnReplaced, bool fOverrideMempoolLimit)
+{
+    const CTransaction& tx = *ws.ptx;
+    const uint256 hash = tx.GetHash();
+    AssertLockHeld(cs_main);
+
+    // Cache the script check result, so that connecting the block that
+    // includes the transaction does not run its scripts again.
+    AddScriptExecutionCache(tx, ws.currentBlockScriptVerifyFlags);
+
+    {
+        LOCK(pool.cs);
+        const unsigned int nSize = ws.pentry->GetTxSize();
 
         // Remove conflicting transactions from the mempool
-        BOOST_FOREACH(const CTxMemPool::txiter it, allConflicting)
+        BOOST_FOREACH(const CTxMemPool::txiter it, ws.allConflicting)
         {
             LogPrint("mempool", "replacing tx %s with %s for %s BTC additional fees, %d delta bytes\n",
                     it->GetTx().GetHash().ToString(),
                     hash.ToString(),
-                    FormatMoney(nModifiedFees - nConflictingFees),
-                    (int)nSize - (int)nConflictingSize);
+                    FormatMoney(ws.nModifiedFees - ws.nConflictingFees),
+                    (int)nSize - (int)ws.nConflictingSize);
             if (plTxnReplaced)
                 plTxnReplaced->push_back(it->GetSharedTx());
         }
-        pool.RemoveStaged(allConflicting, false, MemPoolRemovalReason::REPLACED);
+        pool.RemoveStaged(ws.allConflicting, false, MemPoolRemovalReason::REPLACED);
 
         // This transaction should only count for fee estimation if it isn't a
         // BIP 125 replacement transaction (may not be widely supported), the
         // node is not behind, and the transaction is not dependent on any other
         // transactions in the mempool.
-        bool validForFeeEstimation = !fReplacementTransaction && IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
+        bool validForFeeEstimation = ws.setConflicts.empty() && IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
 
         // Store transaction in memory
-        pool.addUnchecked(hash, entry, setAncestors, validForFeeEstimation);
+        pool.addUnchecked(hash, *ws.pentry, ws.setAncestors, validForFeeEstimation);
 
         // trim mempool and check if tx was trimmed
         if (!fOverrideMempoolLimit) {
@@ -1046,14 +1135,30 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
     return true;
 }
 
+static bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
+                              bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
+                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
+{
+    AssertLockHeld(cs_main);
+    CMemPoolCandidate ws(ptx);
+    if (!PreChecks(pool, state, ws, fLimitFree, pfMissingInputs, nAcceptTime, nAbsurdFee, coins_to_uncache, false))
+        return false;
+
+    PrecomputedTransactionData txdata(*ptx);
+    if (!CheckMemPoolScripts(ws, state, txdata))
+        return false;
+
+    return AddMemPoolCandidate(pool, state, ws, plTxnReplaced, fOverrideMempoolLimit);
+}
+
 bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                         bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> coins_to_uncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache);
     if (!res) {
-        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+        BOOST_FOREACH(const COutPoint& hashTx, coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
     }
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
@@ -1069,6 +1174,160 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee);
 }
 
+/**
+ * Add a mempool candidate whose scripts were checked without holding cs_main.
+ * If the chain or the mempool changed since its PreChecks, which recorded
+ * hashBestBlock and nTransactionsUpdated, the candidate is checked again.
+ */
+static bool AddMemPoolCandidateRechecked(CTxMemPool& pool, CValidationState& state, CMemPoolCandidate& ws, PrecomputedTransactionData& txdata,
+                                         const uint256& hashBestBlock, unsigned int nTransactionsUpdated, bool fLimitFree,
+                                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
+                                         bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
+{
+    AssertLockHeld(cs_main);
+    if (chainActive.Tip()->GetBlockHash() == hashBestBlock && pool.GetTransactionsUpdated() == nTransactionsUpdated)
+        return AddMemPoolCandidate(pool, state, ws, plTxnReplaced, fOverrideMempoolLimit);
+
+    // The chain or the mempool changed in the meantime, so check the
+    // transaction again. If it still passes, it spends the same
+    // outpoints, whose outputs are committed to by their txids, so
+    // the script checks only need to be redone if the flags changed.
+    CMemPoolCandidate wsRecheck(ws.ptx);
+    if (!PreChecks(pool, state, wsRecheck, fLimitFree, pfMissingInputs, nAcceptTime, nAbsurdFee, coins_to_uncache, true))
+        return false;
+    if (wsRecheck.scriptVerifyFlags != ws.scriptVerifyFlags || wsRecheck.currentBlockScriptVerifyFlags != ws.currentBlockScriptVerifyFlags) {
+        if (!CheckMemPoolScripts(wsRecheck, state, txdata))
+            return false;
+    }
+    return AddMemPoolCandidate(pool, state, wsRecheck, plTxnReplaced, fOverrideMempoolLimit);
+}
+
+bool AcceptToMemoryPoolUnlocked(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
+                        bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
+                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+{
+    std::vector<COutPoint> coins_to_uncache;
+    const int64_t nAcceptTime = GetTime();
+    CMemPoolCandidate ws(tx);
+    uint256 hashBestBlock;
+    unsigned int nTransactionsUpdated;
+    bool res;
+    {
+        LOCK(cs_main);
+        res = PreChecks(pool, state, ws, fLimitFree, pfMissingInputs, nAcceptTime, nAbsurdFee, coins_to_uncache, false);
+        hashBestBlock = chainActive.Tip()->GetBlockHash();
+        nTransactionsUpdated = pool.GetTransactionsUpdated();
+    }
+
+    // The expensive part, without holding cs_main: the coins the scripts
+    // check against were copied into ws.view
+    PrecomputedTransactionData txdata(*tx);
+    if (res)
+        res = CheckMemPoolScripts(ws, state, txdata);
+
+    LOCK(cs_main);
+    if (res) {
+        res = AddMemPoolCandidateRechecked(pool, state, ws, txdata, hashBestBlock, nTransactionsUpdated, fLimitFree, pfMissingInputs,
+                                           nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache);
+    }
+    if (!res) {
+        BOOST_FOREACH(const COutPoint& hashTx, coins_to_uncache)
+            pcoinsTip->Uncache(hashTx);
+    }
+    CValidationState stateDummy;
+    FlushStateToDisk(stateDummy, FLUSH_STATE_PERIODIC);
+    return res;
+}
+
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vState,
+                                          std::vector<bool>& vMissingInputs, bool fLimitFree, const CAmount nAbsurdFee)
+{
+    std::vector<bool> vAccepted(vtx.size(), false);
+    vState.assign(vtx.size(), CValidationState());
+    vMissingInputs.assign(vtx.size(), false);
+
+    // Sort the batch into generations: a transaction spending an output of
+    // another one in the batch is in a later generation than its parent.
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++)
+        mapIndex.insert(std::make_pair(vtx[i]->GetHash(), i));
+    std::vector<std::vector<size_t> > vChildren(vtx.size());
+    std::vector<size_t> vParentCount(vtx.size(), 0);
+    std::vector<size_t> vGeneration;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        std::set<size_t> setParents;
+        BOOST_FOREACH(const CTxIn& txin, vtx[i]->vin) {
+            std::map<uint256, size_t>::const_iterator it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && it->second != i && setParents.insert(it->second).second)
+                vChildren[it->second].push_back(i);
+        }
+        vParentCount[i] = setParents.size();
+        if (setParents.empty())
+            vGeneration.push_back(i);
+    }
+
+    while (!vGeneration.empty()) {
+        const int64_t nAcceptTime = GetTime();
+        std::vector<std::unique_ptr<CMemPoolCandidate> > vCandidates(vGeneration.size());
+        std::vector<std::unique_ptr<PrecomputedTransactionData> > vTxData(vGeneration.size());
+        std::vector<std::vector<COutPoint> > vCoinsToUncache(vGeneration.size());
+        std::vector<CValidationState*> vpState(vGeneration.size());
+        uint256 hashBestBlock;
+        unsigned int nTransactionsUpdated;
+        {
+            LOCK(cs_main);
+            for (size_t k = 0; k < vGeneration.size(); k++) {
+                const size_t i = vGeneration[k];
+                bool fMissingInputs = false;
+                vpState[k] = &vState[i];
+                vCandidates[k].reset(new CMemPoolCandidate(vtx[i]));
+                if (!PreChecks(pool, vState[i], *vCandidates[k], fLimitFree, &fMissingInputs, nAcceptTime, nAbsurdFee, vCoinsToUncache[k], false))
+                    vCandidates[k].reset();
+                vMissingInputs[i] = fMissingInputs;
+            }
+            hashBestBlock = chainActive.Tip()->GetBlockHash();
+            nTransactionsUpdated = pool.GetTransactionsUpdated();
+        }
+
+        CheckMemPoolScriptsParallel(vCandidates, vTxData, vpState);
+
+        {
+            // All but the first transaction added see a changed mempool, and
+            // are checked again for conflicts with their siblings
+            LOCK(cs_main);
+            for (size_t k = 0; k < vGeneration.size(); k++) {
+                const size_t i = vGeneration[k];
+                if (vCandidates[k]) {
+                    bool fMissingInputs = false;
+                    vAccepted[i] = AddMemPoolCandidateRechecked(pool, vState[i], *vCandidates[k], *vTxData[k], hashBestBlock, nTransactionsUpdated,
+                                                                fLimitFree, &fMissingInputs, nAcceptTime, NULL, false, nAbsurdFee, vCoinsToUncache[k]);
+                    vMissingInputs[i] = fMissingInputs;
+                }
+                if (!vAccepted[i]) {
+                    BOOST_FOREACH(const COutPoint& hashTx, vCoinsToUncache[k])
+                        pcoinsTip->Uncache(hashTx);
+                }
+            }
+        }
+
+        // Children whose parents in the batch have all been tried go next,
+        // in the order they were given
+        std::vector<size_t> vNext;
+        BOOST_FOREACH(size_t i, vGeneration) {
+            BOOST_FOREACH(size_t j, vChildren[i]) {
+                if (--vParentCount[j] == 0)
+                    vNext.push_back(j);
+            }
+        }
+        std::sort(vNext.begin(), vNext.end());
+        vGeneration.swap(vNext);
+    }
+
+    CValidationState stateDummy;
+    FlushStateToDisk(stateDummy, FLUSH_STATE_PERIODIC);
+    return vAccepted;
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1105,15 +1364,8 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
     }
 
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
-        int nHeight = -1;
-        {
-            const CCoinsViewCache& view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
-        }
-        if (nHeight > 0)
-            pindexSlow = chainActive[nHeight];
+        const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+        if (!coin.IsSpent()) pindexSlow = chainActive[coin.nHeight];
     }
 
     if (pindexSlow) {
@@ -1163,6 +1415,27 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
+/* Check the proof of work of a block header like CheckAuxPowProofOfWork,
+   but take the scrypt hash from the PoW cache if it has been computed
+   before, and remember it there once the check passed.  */
+static bool CheckAuxPowProofOfWorkCached(const CBlockHeader& block, const Consensus::Params& consensusParams)
+{
+    if (ppowcache == NULL)
+        return CheckAuxPowProofOfWork(block, consensusParams);
+
+    const CPureBlockHeader& powHeader = GetPoWHeader(block);
+    const uint256 hash = powHeader.GetHash();
+    uint256 hashPoW;
+    if (ppowcache->ReadPoWHash(hash, hashPoW))
+        return CheckAuxPowProofOfWork(block, consensusParams, &hashPoW);
+
+    hashPoW = powHeader.GetPoWHash();
+    if (!CheckAuxPowProofOfWork(block, consensusParams, &hashPoW))
+        return false;
+    ppowcache->WritePoWHashes(std::vector<std::pair<uint256, uint256> >(1, std::make_pair(hash, hashPoW)));
+    return true;
+}
+
 /* Generic implementation of block reading that can handle
    both a block and its header.  */
 
@@ -1185,7 +1458,7 @@ static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensu
     }
 
     // Check the header
-    if (fCheckPOW && !CheckAuxPowProofOfWork(block, consensusParams))
+    if (fCheckPOW && !CheckAuxPowProofOfWorkCached(block, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -1217,6 +1490,51 @@ bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, con
     return ReadBlockOrHeader(block, pindex, consensusParams, fCheckPOW);
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    // Blocks are stored after their message start and size, see WriteBlockToDisk
+    if (pos.nPos < 8)
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    CDiskBlockPos hpos = pos;
+    hpos.nPos -= 8;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+
+        filein >> FLATDATA(blk_start) >> blk_size;
+
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: Block magic mismatch for %s", __func__, pos.ToString());
+
+        if (blk_size > MAX_SIZE)
+            return error("%s: Block data is larger than maximum deserialization size for %s: %u > %u",
+                    __func__, pos.ToString(), blk_size, MAX_SIZE);
+
+        block.resize(blk_size);
+        filein.read((char*)block.data(), blk_size);
+    }
+    catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    if (!ReadRawBlockFromDisk(block, pindex->GetBlockPos(), message_start))
+        return false;
+    // The block hash only covers the fixed size header at the start of the data
+    if (block.size() < 80 || Hash(block.begin(), block.begin() + 80) != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__,
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 bool IsInitialBlockDownload()
 {
     const CChainParams& chainParams = Params();
@@ -1368,24 +1686,13 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
-            // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                undo.nVersion = coins->nVersion;
-            }
+            txundo.vprevout.emplace_back();
+            bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+            assert(is_spent);
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
@@ -1397,6 +1704,20 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
+    if (pdeferred) {
+        // Run the script assuming all signatures are valid. If it fails that
+        // way, it may rely on an invalid signature, so fall back to the
+        // inline verification below.
+        std::vector<CDeferredSigCheck> vSigs;
+        if (VerifyScript(scriptSig, scriptPubKey, witness, nFlags, DeferringTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *txdata, vSigs), &error)) {
+            if (!vSigs.empty()) {
+                CScriptCheck check(*this);
+                check.pdeferred = NULL;
+                pdeferred->Add(std::move(check), std::move(vSigs));
+            }
+            return true;
+        }
+    }
     if (!VerifyScript(scriptSig, scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *txdata), &error)) {
         return false;
     }
@@ -1423,22 +1744,22 @@ bool CheckTxInputs(const CChainParams& params, const CTransaction& tx, CValidati
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase()) {
+            if (coin.IsCoinBase()) {
                 // Dogecoin: Switch maturity at depth 145,000
-                int nCoinbaseMaturity = params.GetConsensus(coins->nHeight).nCoinbaseMaturity;
-                if (nSpendHeight - coins->nHeight < nCoinbaseMaturity)
+                int nCoinbaseMaturity = params.GetConsensus(coin.nHeight).nCoinbaseMaturity;
+                if (nSpendHeight - coin.nHeight < nCoinbaseMaturity)
                     return state.Invalid(false,
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight));
+                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coin.nHeight));
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
         }
@@ -1458,7 +1779,93 @@ bool CheckTxInputs(const CChainParams& params, const CTransaction& tx, CValidati
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
+static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static uint256 scriptExecutionCacheNonce(GetRandHash());
+
+void InitScriptExecutionCache() {
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20) / 2;
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+static uint256 GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+static bool IsScriptExecutionCached(const CTransaction& tx, unsigned int flags)
+{
+    AssertLockHeld(cs_main); // The cache is only safe to modify under cs_main
+    return scriptExecutionCache.contains(GetScriptExecutionCacheEntry(tx, flags), false);
+}
+
+static void AddScriptExecutionCache(const CTransaction& tx, unsigned int flags)
+{
+    AssertLockHeld(cs_main);
+    scriptExecutionCache.insert(GetScriptExecutionCacheEntry(tx, flags));
+}
+
+/**
+ * Check the scripts of all inputs of tx, or append the checks to pvChecks.
+ * Unlike CheckInputs, this neither does the other input checks nor uses the
+ * script execution cache, and does not need cs_main.
+ */
+static bool CheckInputScripts(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, CDeferredSigChecks *pdeferred)
+{
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const COutPoint &prevout = tx.vin[i].prevout;
+        const Coin& coin = inputs.AccessCoin(prevout);
+        assert(!coin.IsSpent());
+
+        // We very carefully only pass in things to CScriptCheck which
+        // are clearly committed to by tx' witness hash. This provides
+        // a sanity check that our caching is not introducing consensus
+        // failures through additional data in, eg, the coins being
+        // spent being checked as a part of CScriptCheck.
+        const CScript& scriptPubKey = coin.out.scriptPubKey;
+        const CAmount amount = coin.out.nValue;
+
+        // Verify signature
+        CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheSigStore, &txdata, pvChecks ? pdeferred : NULL);
+        if (pvChecks) {
+            pvChecks->push_back(CScriptCheck());
+            check.swap(pvChecks->back());
+        } else if (!check()) {
+            if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
+                // Check whether the failure was caused by a
+                // non-mandatory script verification check, such as
+                // non-standard DER encodings or non-null dummy
+                // arguments; if so, don't trigger DoS protection to
+                // avoid splitting the network between upgraded and
+                // non-upgraded nodes.
+                CScriptCheck check2(scriptPubKey, amount, tx, i,
+                        flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &txdata);
+                if (check2())
+                    return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
+            }
+            // Failures of other flags indicate a transaction that is
+            // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
+            // such nodes as they are not following the protocol. That
+            // said during an upgrade careful thought should be taken
+            // as to the correct behavior - we may want to continue
+            // peering with non-upgraded nodes even after soft-fork
+            // super-majority signaling has occurred.
+            return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+        }
+    }
+
+    return true;
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, CDeferredSigChecks *pdeferred)
 {
     if (!tx.IsCoinBase())
     {
@@ -1478,38 +1885,24 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // Of course, if an assumed valid block is invalid due to false scriptSigs
         // this optimization would allow an invalid chain to be accepted.
         if (fScriptChecks) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
-
-                // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
-                if (pvChecks) {
-                    pvChecks->push_back(CScriptCheck());
-                    check.swap(pvChecks->back());
-                } else if (!check()) {
-                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
-                        // Check whether the failure was caused by a
-                        // non-mandatory script verification check, such as
-                        // non-standard DER encodings or non-null dummy
-                        // arguments; if so, don't trigger DoS protection to
-                        // avoid splitting the network between upgraded and
-                        // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
-                        if (check2())
-                            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
-                    }
-                    // Failures of other flags indicate a transaction that is
-                    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
-                    // such nodes as they are not following the protocol. That
-                    // said during an upgrade careful thought should be taken
-                    // as to the correct behavior - we may want to continue
-                    // peering with non-upgraded nodes even after soft-fork
-                    // super-majority signaling has occurred.
-                    return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
-                }
+            // First check if script executions have been cached with the same
+            // flags. Note that this assumes that the inputs provided are
+            // correct (ie that the transaction hash which is in tx's prevouts
+            // properly commits to the scriptPubKey in the inputs view of that
+            // transaction).
+            uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
+            AssertLockHeld(cs_main); // The cache is only safe to modify under cs_main
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+                return true;
+            }
+
+            if (!CheckInputScripts(tx, state, inputs, flags, cacheSigStore, txdata, pvChecks, pdeferred))
+                return false;
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // We executed all of the provided scripts, and were told to
+                // cache the result. Do so now.
+                scriptExecutionCache.insert(hashCacheEntry);
             }
         }
     }
@@ -1594,39 +1987,40 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 } // anon namespace
 
 /**
- * Apply the undo operation of a CTxInUndo to the given chain state.
- * @param undo The undo object.
+ * Restore the UTXO in a Coin at a given COutPoint
+ * @param undo The Coin to be restored.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 {
     bool fClean = true;
 
-    CCoinsModifier coins = view.ModifyCoins(out.hash);
-    if (undo.nHeight != 0) {
-        // undo data contains height: this is the last output of the prevout tx being spent
-        if (!coins->IsPruned())
-            fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-        coins->Clear();
-        coins->fCoinBase = undo.fCoinBase;
-        coins->nHeight = undo.nHeight;
-        coins->nVersion = undo.nVersion;
-    } else {
-        if (coins->IsPruned())
-            fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
+    if (view.HaveCoin(out)) fClean = false; // overwriting transaction output
+
+    if (undo.nHeight == 0) {
+        // Missing undo metadata (height and coinbase). Older versions included this
+        // information only in undo records for the last spend of a transactions'
+        // outputs. This implies that it must be present for some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (!alternate.IsSpent()) {
+            undo.nHeight = alternate.nHeight;
+            undo.fCoinBase = alternate.fCoinBase;
+        } else {
+            return error("%s: undo data adding output to missing transaction", __func__);
+        }
     }
-    if (coins->IsAvailable(out.n))
-        fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-    if (coins->vout.size() < out.n+1)
-        coins->vout.resize(out.n+1);
-    coins->vout[out.n] = undo.txout;
+    // The potential_overwrite parameter to AddCoin is only allowed to be false if we know for
+    // sure that the coin did not already exist in the cache. As we have queried for that above
+    // using HaveCoin, we don't need to guess. When fClean is false, a coin already existed and
+    // it is an overwrite.
+    view.AddCoin(out, std::move(undo), !fClean);
 
     return fClean;
 }
 
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, CUTXOSetHash* pUTXOSetHash)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -1652,78 +2046,396 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
-        {
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-        if (*outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
-
-        // remove outputs
-        outs->Clear();
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || tx.IsCoinBase() != coin.fCoinBase) {
+                    fClean = false; // transaction output mismatch
+                }
+                if (is_spent && pUTXOSetHash)
+                    pUTXOSetHash->RemoveCoin(out, coin);
+            }
         }
 
         // restore inputs
         if (i > 0) { // not coinbases
-            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock(): transaction and undo data inconsistent");
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, out))
+                if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out))
                     fClean = false;
+                if (pUTXOSetHash && view.HaveCoin(out))
+                    pUTXOSetHash->AddCoin(out, view.AccessCoin(out));
+            }
+            // At this point, all of txundo.vprevout should have been moved out.
+        }
+    }
+
+    // move best block pointer to prevout block
+    view.SetBestBlock(pindex->pprev->GetBlockHash());
+
+    if (pfClean) {
+        *pfClean = fClean;
+        return true;
+    }
+
+    return fClean;
+}
+
+void static FlushBlockFile(bool fFinalize = false)
+{
+    LOCK(cs_LastBlockFile);
+
+    CDiskBlockPos posOld(nLastBlockFile, 0);
+
+    FILE *fileOld = OpenBlockFile(posOld);
+    if (fileOld) {
+        if (fFinalize)
+            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        FileCommit(fileOld);
+        fclose(fileOld);
+    }
+
+    fileOld = OpenUndoFile(posOld);
+    if (fileOld) {
+        if (fFinalize)
+            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
+        FileCommit(fileOld);
+        fclose(fileOld);
+    }
+}
+
+bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck() {
+    RenameThread("dogecoin-scriptch");
+    scriptcheckqueue.Thread();
+}
+
+/**
+ * Check the scripts of several mempool candidates, resetting those which
+ * fail. The checks with the standard flags run together on the script check
+ * threads; only if one of them fails are the candidates checked one by one,
+ * to tell which. Does not need cs_main.
+ */
+static void CheckMemPoolScriptsParallel(std::vector<std::unique_ptr<CMemPoolCandidate> >& vCandidates, std::vector<std::unique_ptr<PrecomputedTransactionData> >& vTxData, const std::vector<CValidationState*>& vpState)
+{
+    for (size_t k = 0; k < vCandidates.size(); k++) {
+        if (vCandidates[k])
+            vTxData[k].reset(new PrecomputedTransactionData(*vCandidates[k]->ptx));
+    }
+
+    bool fStandardChecked = false;
+    if (nScriptCheckThreads) {
+        std::vector<CScriptCheck> vChecks;
+        for (size_t k = 0; k < vCandidates.size(); k++) {
+            if (vCandidates[k])
+                CheckInputScripts(*vCandidates[k]->ptx, *vpState[k], vCandidates[k]->view, vCandidates[k]->scriptVerifyFlags, true, *vTxData[k], &vChecks, NULL);
+        }
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        fStandardChecked = control.Wait();
+    }
+
+    // With the standard flags passing, what is left is the check against
+    // the next block's flags, whose signatures are now cached
+    for (size_t k = 0; k < vCandidates.size(); k++) {
+        if (vCandidates[k] && !CheckMemPoolScripts(*vCandidates[k], *vpState[k], *vTxData[k], fStandardChecked))
+            vCandidates[k].reset();
+    }
+}
+
+// Each check already covers a group of headers, so workers take one at a time
+static CCheckQueue<CHeaderPoWCheck> headercheckqueue(1);
+
+void ThreadHeaderCheck() {
+    RenameThread("dogecoin-headerch");
+    headercheckqueue.Thread();
+}
+
+// Number of signatures verified by a single deferred signature check
+static const size_t SIG_VERIFY_GROUP_SIZE = 16;
+
+static CCheckQueue<CSigVerifyCheck> sigverifyqueue(1);
+
+void ThreadSigVerify() {
+    RenameThread("dogecoin-sigverify");
+    sigverifyqueue.Thread();
+}
+
+bool CSigVerifyCheck::operator()() {
+    if (vChecks.empty())
+        return true;
+    const CParsedPubKey pubkey(vChecks[0]->pubkey);
+    for (CDeferredSigCheck* pcheck : vChecks)
+        pcheck->fValid = pubkey.Verify(pcheck->sighash, pcheck->vchSig);
+    return true;
+}
+
+void CDeferredSigChecks::Add(CScriptCheck&& check, std::vector<CDeferredSigCheck>&& vSigs)
+{
+    LOCK(cs);
+    vScripts.emplace_back(std::move(check), std::move(vSigs));
+}
+
+bool CDeferredSigChecks::Verify()
+{
+    LOCK(cs);
+
+    // Order the checks by public key, so that identical checks are adjacent
+    // and each group below shares one parsed key.
+    std::vector<CDeferredSigCheck*> vSigs;
+    for (auto& script : vScripts) {
+        for (CDeferredSigCheck& sig : script.second)
+            vSigs.push_back(&sig);
+    }
+    auto key = [](const CDeferredSigCheck* p) { return std::tie(p->pubkey, p->sighash, p->vchSig); };
+    std::sort(vSigs.begin(), vSigs.end(), [&key](const CDeferredSigCheck* a, const CDeferredSigCheck* b) { return key(a) < key(b); });
+
+    std::vector<CSigVerifyCheck> vChecks;
+    std::vector<CDeferredSigCheck*> vGroup;
+    for (size_t i = 0; i < vSigs.size(); i++) {
+        if (i > 0 && key(vSigs[i]) == key(vSigs[i - 1]))
+            continue;
+        if (!vGroup.empty() && (vGroup.size() == SIG_VERIFY_GROUP_SIZE || vGroup[0]->pubkey != vSigs[i]->pubkey)) {
+            vChecks.emplace_back(vGroup);
+            vGroup.clear();
+        }
+        vGroup.push_back(vSigs[i]);
+    }
+    if (!vGroup.empty())
+        vChecks.emplace_back(vGroup);
+
+    {
+        CCheckQueueControl<CSigVerifyCheck> control(&sigverifyqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    // Duplicates take the outcome of the first identical check
+    for (size_t i = 1; i < vSigs.size(); i++) {
+        if (key(vSigs[i]) == key(vSigs[i - 1]))
+            vSigs[i]->fValid = vSigs[i - 1]->fValid;
+    }
+
+    bool fAllOk = true;
+    for (auto& script : vScripts) {
+        bool fValid = true;
+        for (const CDeferredSigCheck& sig : script.second)
+            fValid = fValid && sig.fValid;
+        if (!fValid) {
+            if (!script.first()) {
+                fAllOk = false;
+                break;
+            }
+        } else if (script.first.IsCacheStore()) {
+            for (const CDeferredSigCheck& sig : script.second)
+                AddSignatureCacheEntry(sig.vchSig, sig.pubkey, sig.sighash);
+        }
+    }
+    vScripts.clear();
+    return fAllOk;
+}
+
+// Number of outpoints looked up by a single coins prefetch check
+static const size_t COINS_PREFETCH_GROUP_SIZE = 16;
+
+static CCheckQueue<CCoinsPrefetchCheck> coinsprefetchqueue(1);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("dogecoin-prefetch");
+    coinsprefetchqueue.Thread();
+}
+
+void ThreadFlushCoins() {
+    RenameThread("dogecoin-flush");
+    pcoinsflusher->Thread();
+}
+
+// Number of blocks ActivateBestChainStep has read and checked ahead of connecting them
+static const unsigned int BLOCK_READ_AHEAD = 16;
+
+/**
+ * Loads the blocks about to be connected ahead of ConnectTip.
+ *
+ * Reading a block from disk and its context-free checks (CheckBlock, and the
+ * transaction hashing done while deserializing) do not depend on the chain
+ * state, so worker threads running Thread() do them for the next blocks
+ * while the current one is being connected. A block that passes CheckBlock
+ * is marked checked, so ConnectBlock skips the check; one that fails is
+ * handed out unmarked, for ConnectBlock to reject it the usual way.
+ * Without running workers, nothing is read ahead.
+ */
+class CBlockReadAhead
+{
+private:
+    struct Entry {
+        CDiskBlockPos pos;
+        int nHeight;
+        bool fStarted;
+        bool fDone;
+        std::shared_ptr<const CBlock> pblock;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    //! Blocks to read ahead, by hash
+    std::map<uint256, Entry> mapBlocks;
+    //! Blocks not started yet, in the order they will be connected
+    std::deque<uint256> queue;
+    int nWorkers;
+
+    static std::shared_ptr<const CBlock> Load(const uint256& hash, const CDiskBlockPos& pos, int nHeight)
+    {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblock, pos, Params().GetConsensus(nHeight)) || pblock->GetHash() != hash)
+            return nullptr;
+        CValidationState state;
+        CheckBlock(*pblock, state);
+        return pblock;
+    }
+
+public:
+    CBlockReadAhead() : nWorkers(0) {}
+
+    //! Read the given blocks ahead, in order, and forget about any others. Requires cs_main.
+    void Prefetch(const std::vector<const CBlockIndex*>& vpindex)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        std::map<uint256, Entry> mapKept;
+        queue.clear();
+        if (nWorkers > 0) {
+            for (const CBlockIndex* pindex : vpindex) {
+                if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                    continue;
+                const uint256 hash = pindex->GetBlockHash();
+                std::map<uint256, Entry>::iterator it = mapBlocks.find(hash);
+                if (it != mapBlocks.end()) {
+                    mapKept.insert(*it);
+                    if (it->second.fStarted || it->second.fDone)
+                        continue;
+                } else {
+                    mapKept.insert(std::make_pair(hash, Entry{pindex->GetBlockPos(), pindex->nHeight, false, false, nullptr}));
+                }
+                queue.push_back(hash);
             }
         }
+        // Workers busy with a block dropped here discard it when done.
+        mapBlocks.swap(mapKept);
+        if (!queue.empty())
+            cond.notify_all();
     }
 
-    // move best block pointer to prevout block
-    view.SetBestBlock(pindex->pprev->GetBlockHash());
-
-    if (pfClean) {
-        *pfClean = fClean;
-        return true;
+    //! Take a block that was read ahead, waiting for it if it is being read. Returns NULL if it was not queued.
+    std::shared_ptr<const CBlock> Get(const CBlockIndex* pindex)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        boost::this_thread::disable_interruption di;
+        std::map<uint256, Entry>::iterator it = mapBlocks.find(pindex->GetBlockHash());
+        if (it == mapBlocks.end())
+            return nullptr;
+        if (!it->second.fStarted && !it->second.fDone) {
+            // No worker got to it yet; read it here rather than wait.
+            const CDiskBlockPos pos = it->second.pos;
+            const int nHeight = it->second.nHeight;
+            mapBlocks.erase(it);
+            lock.unlock();
+            return Load(pindex->GetBlockHash(), pos, nHeight);
+        }
+        while (!it->second.fDone)
+            cond.wait(lock);
+        std::shared_ptr<const CBlock> pblock = it->second.pblock;
+        mapBlocks.erase(it);
+        return pblock;
     }
 
-    return fClean;
-}
-
-void static FlushBlockFile(bool fFinalize = false)
-{
-    LOCK(cs_LastBlockFile);
+    //! Read the queued blocks ahead, until interrupted.
+    void Thread()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nWorkers++;
+        try {
+            while (true) {
+                while (queue.empty())
+                    cond.wait(lock);
+                const uint256 hash = queue.front();
+                queue.pop_front();
+                std::map<uint256, Entry>::iterator it = mapBlocks.find(hash);
+                if (it == mapBlocks.end() || it->second.fStarted || it->second.fDone)
+                    continue;
+                it->second.fStarted = true;
+                const CDiskBlockPos pos = it->second.pos;
+                const int nHeight = it->second.nHeight;
+
+                lock.unlock();
+                std::shared_ptr<const CBlock> pblock = Load(hash, pos, nHeight);
+                lock.lock();
+
+                // Entries may have been dropped and queued again meanwhile.
+                it = mapBlocks.find(hash);
+                if (it != mapBlocks.end() && !it->second.fDone) {
+                    it->second.pblock = pblock;
+                    it->second.fDone = true;
+                    cond.notify_all();
+                }
+            }
+        } catch (const boost::thread_interrupted&) {
+            nWorkers--;
+            throw;
+        }
+    }
+};
 
-    CDiskBlockPos posOld(nLastBlockFile, 0);
+static CBlockReadAhead blockreadahead;
 
-    FILE *fileOld = OpenBlockFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
+void ThreadBlockReadAhead() {
+    RenameThread("dogecoin-readahead");
+    blockreadahead.Thread();
+}
 
-    fileOld = OpenUndoFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
+bool CCoinsPrefetchCheck::operator()() {
+    for (std::pair<COutPoint, Coin> *p = pbegin; p != pend; p++) {
+        if (!pview->GetCoin(p->first, p->second))
+            p->second.Clear();
     }
+    return true;
 }
 
-bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
-
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
-void ThreadScriptCheck() {
-    RenameThread("dogecoin-scriptch");
-    scriptcheckqueue.Thread();
+bool CHeaderPoWCheck::operator()() {
+    // Only hash the headers whose PoW hash is not cached yet
+    std::vector<uint256> vHashes(vHeaders.size());
+    std::vector<uint256> vPoWHashes(vHeaders.size());
+    std::vector<bool> vfCached(vHeaders.size(), false);
+    std::vector<const CPureBlockHeader*> vPoWHeaders;
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        const CPureBlockHeader& powHeader = GetPoWHeader(*vHeaders[i]);
+        if (ppowcache != NULL) {
+            vHashes[i] = powHeader.GetHash();
+            vfCached[i] = ppowcache->ReadPoWHash(vHashes[i], vPoWHashes[i]);
+        }
+        if (!vfCached[i])
+            vPoWHeaders.push_back(&powHeader);
+    }
+    std::vector<uint256> vComputed;
+    CPureBlockHeader::GetPoWHashes(vPoWHeaders, vComputed);
+
+    std::vector<std::pair<uint256, uint256> > vNewPoWHashes;
+    for (size_t i = 0, j = 0; i < vHeaders.size(); i++) {
+        if (!vfCached[i])
+            vPoWHashes[i] = vComputed[j++];
+        *vfValid[i] = CheckAuxPowProofOfWork(*vHeaders[i], Params().GetConsensus(0), &vPoWHashes[i]);
+        if (*vfValid[i] && !vfCached[i])
+            vNewPoWHashes.push_back(std::make_pair(vHashes[i], vPoWHashes[i]));
+    }
+    if (ppowcache != NULL && !vNewPoWHashes.empty())
+        ppowcache->WritePoWHashes(vNewPoWHashes);
+    return true;
 }
 
 // Protected by cs_main
@@ -1773,14 +2485,53 @@ static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
+static int64_t nTimePrefetch = 0;
+static int64_t nPrefetchCached = 0;
+static int64_t nPrefetchRead = 0;
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev, int nHeight, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+
+    const Consensus::Params& consensus = chainparams.GetConsensus(nHeight);
+
+    // BIP16 didn't become active until Apr 1 2012
+    // Dogecoin: BIP16 has been enabled since inception
+    bool fStrictPayToScriptHash = true;
+
+    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+
+    // Start enforcing the DERSIG (BIP66) rule
+    if (nHeight >= chainparams.GetConsensus(0).BIP66Height) {
+        flags |= SCRIPT_VERIFY_DERSIG;
+    }
+
+    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4 blocks
+    if (nHeight >= chainparams.GetConsensus(0).BIP65Height) {
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    }
+
+    // Start enforcing BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    if (VersionBitsState(pindexPrev, consensus, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
+        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    }
+
+    // Start enforcing WITNESS rules using versionbits logic.
+    if (IsWitnessEnabled(pindexPrev, consensus)) {
+        flags |= SCRIPT_VERIFY_WITNESS;
+        flags |= SCRIPT_VERIFY_NULLDUMMY;
+    }
+
+    return flags;
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, CUTXOSetHash* pUTXOSetHash)
 {
     AssertLockHeld(cs_main);
 
@@ -1879,47 +2630,71 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fEnforceBIP30) {
         for (const auto& tx : block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx->GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx->vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx->GetHash(), o))) {
+                    return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+                }
+            }
         }
     }
 
-    // BIP16 didn't become active until Apr 1 2012
-    // Dogecoin: BIP16 has been enabled since inception
-    bool fStrictPayToScriptHash = true;
-
-    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
-
-    // Start enforcing the DERSIG (BIP66) rule
-    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP66Height) {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
-
-    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4 blocks
-    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP65Height) {
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-    }
+    unsigned int flags = GetBlockScriptFlags(pindex->pprev, pindex->nHeight, chainparams);
 
-    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    // Start enforcing BIP68 (sequence locks) using versionbits logic.
     int nLockTimeFlags = 0;
     if (VersionBitsState(pindex->pprev, consensus, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
-        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
         nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
     }
 
-    // Start enforcing WITNESS rules using versionbits logic.
-    if (IsWitnessEnabled(pindex->pprev, consensus)) {
-        flags |= SCRIPT_VERIFY_WITNESS;
-        flags |= SCRIPT_VERIFY_NULLDUMMY;
-    }
-
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
+    // Load the inputs that are not cached yet from the coins database using
+    // several readers, so the loop below only has to look at the cache.
+    if (nScriptCheckThreads && block.vtx.size() > 1) {
+        std::set<uint256> setBlockTxids;
+        for (const auto& tx : block.vtx)
+            setBlockTxids.insert(tx->GetHash());
+        unsigned int nCached = 0;
+        std::vector<std::pair<COutPoint, Coin> > vPrefetch;
+        for (const auto& tx : block.vtx) {
+            if (tx->IsCoinBase())
+                continue;
+            for (const CTxIn& txin : tx->vin) {
+                if (setBlockTxids.count(txin.prevout.hash))
+                    continue;
+                if (view.HaveCoinInCache(txin.prevout) || pcoinsTip->HaveCoinInCache(txin.prevout))
+                    nCached++;
+                else
+                    vPrefetch.emplace_back(txin.prevout, Coin());
+            }
+        }
+        if (!vPrefetch.empty()) {
+            std::vector<CCoinsPrefetchCheck> vChecks;
+            for (size_t i = 0; i < vPrefetch.size(); i += COINS_PREFETCH_GROUP_SIZE) {
+                vChecks.emplace_back(pcoinsTip->GetBackend(), vPrefetch.data() + i,
+                                     vPrefetch.data() + std::min(i + COINS_PREFETCH_GROUP_SIZE, vPrefetch.size()));
+            }
+            CCheckQueueControl<CCoinsPrefetchCheck> prefetch(&coinsprefetchqueue);
+            prefetch.Add(vChecks);
+            prefetch.Wait();
+            for (auto& entry : vPrefetch)
+                pcoinsTip->CacheCoin(entry.first, std::move(entry.second));
+        }
+        nPrefetchCached += nCached;
+        nPrefetchRead += vPrefetch.size();
+        int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+        LogPrint("bench", "    - Prefetch %u inputs (%u cached, %u read): %.2fms [%.2fs (%d cached, %d read)]\n",
+                 nCached + vPrefetch.size(), nCached, vPrefetch.size(), 0.001 * (nTimePrefetched - nTime2),
+                 nTimePrefetch * 0.000001, nPrefetchCached, nPrefetchRead);
+    }
+
     CBlockUndo blockundo;
 
+    // Must outlive control, whose script checks may still add to it
+    CDeferredSigChecks deferredSigChecks;
+    const bool fDeferredSigChecks = fDeferSigChecks && fScriptChecks && nScriptCheckThreads;
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     std::vector<int> prevheights;
@@ -1949,7 +2724,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // be in ConnectBlock because they require the UTXO set
             prevheights.resize(tx.vin.size());
             for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             }
 
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
@@ -1974,7 +2749,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL,
+                             fDeferredSigChecks ? &deferredSigChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
@@ -2001,6 +2777,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (!control.Wait())
         return state.DoS(100, false);
+    if (fDeferredSigChecks && !deferredSigChecks.Verify())
+        return state.DoS(100, false);
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
 
@@ -2033,6 +2811,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
+    if (pUTXOSetHash) {
+        for (unsigned int i = 0; i < block.vtx.size(); i++) {
+            const CTransaction &tx = *(block.vtx[i]);
+            if (i > 0) {
+                const CTxUndo &txundo = blockundo.vtxundo[i-1];
+                for (unsigned int j = 0; j < tx.vin.size(); j++)
+                    pUTXOSetHash->RemoveCoin(tx.vin[j].prevout, txundo.vprevout[j]);
+            }
+            for (unsigned int o = 0; o < tx.vout.size(); o++) {
+                if (!tx.vout[o].scriptPubKey.IsUnspendable())
+                    pUTXOSetHash->AddCoin(COutPoint(tx.GetHash(), o), Coin(tx.vout[o], pindex->nHeight, tx.IsCoinBase()));
+            }
+        }
+    }
+
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
 
@@ -2092,10 +2885,14 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     }
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+    // Coins still being written in the background count against the same limit.
+    if (pcoinsflusher)
+        cacheSize += pcoinsflusher->DynamicMemoryUsage();
     int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
     // The cache is large and we're within 10% and 200 MiB or 50% and 50MiB of the limit, but we have time now (not in the middle of a block processing).
-    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::min(std::max(nTotalSpace / 2, nTotalSpace - MIN_BLOCK_COINSDB_USAGE * 1024 * 1024),
-                                                                            std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024));
+    int64_t nLargeCacheSize = std::min(std::max(nTotalSpace / 2, nTotalSpace - MIN_BLOCK_COINSDB_USAGE * 1024 * 1024),
+                                       std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024));
+    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > nLargeCacheSize;
     // The cache is over the limit, we have to write now.
     bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
     // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
@@ -2136,15 +2933,27 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
+        // With a background flusher this only hands the coins over to it,
+        // unless it is still busy with the previous flush.
+        // Unless forced, keep the cache warm: everything is written, but
+        // only the least recently used coins are evicted, down to half the
+        // size that makes the cache large, leaving room for the next blocks.
+        if (fUTXOSetHashTip)
+            pcoinsdbview->SetUTXOSetHash(pcoinsTip->GetBestBlock(), utxoSetHashTip);
+        bool fFlushed = mode == FLUSH_STATE_ALWAYS ? pcoinsTip->Flush() : pcoinsTip->FlushAndTrim(nLargeCacheSize / 2 / DB_PEAK_USAGE_FACTOR);
+        if (!fFlushed)
+            return AbortNode(state, "Failed to write to coin database");
+        // Callers of a forced flush expect the coin database to be up to
+        // date, and pruned block files must not be needed to catch it up.
+        if (pcoinsflusher && (mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinsflusher->Sync())
             return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
     }
@@ -2246,10 +3055,12 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        CUTXOSetHash utxoSetHash(utxoSetHashTip);
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, fUTXOSetHashTip ? &utxoSetHash : NULL))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
+        utxoSetHashTip = utxoSetHash;
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
@@ -2329,7 +3140,8 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
+        CUTXOSetHash utxoSetHash(utxoSetHashTip);
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false, fUTXOSetHashTip ? &utxoSetHash : NULL);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2340,6 +3152,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         bool flushed = view.Flush();
         assert(flushed);
+        utxoSetHashTip = utxoSetHash;
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
@@ -2464,9 +3277,19 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
         nHeight = nTargetHeight;
 
+        // Have the next blocks read and checked while the first ones are connected.
+        std::vector<const CBlockIndex*> vpindexReadAhead;
+        BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
+            if (vpindexReadAhead.size() == BLOCK_READ_AHEAD)
+                break;
+            if (pindexConnect != pindexMostWork || !pblock)
+                vpindexReadAhead.push_back(pindexConnect);
+        }
+        blockreadahead.Prefetch(vpindexReadAhead);
+
         // Connect new blocks.
         BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace)) {
+            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork && pblock ? pblock : blockreadahead.Get(pindexConnect), connectTrace)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -2787,6 +3610,37 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
 }
 
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
+/**
+ * Set nChainTx for pindexNew, whose parents all have it set, and for any
+ * descendants in mapBlocksUnlinked that were only waiting for it.
+ */
+static void LinkBlockTransactions(CBlockIndex *pindexNew)
+{
+    std::deque<CBlockIndex*> queue;
+    queue.push_back(pindexNew);
+
+    // Recursively process any descendant blocks that now may be eligible to be connected.
+    while (!queue.empty()) {
+        CBlockIndex *pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        if (chainActive.Tip() == NULL || !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
+            setBlockIndexCandidates.insert(pindex);
+        }
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
+            queue.push_back(it->second);
+            range.first++;
+            mapBlocksUnlinked.erase(it);
+        }
+    }
+}
+
 bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos)
 {
     pindexNew->nTx = block.vtx.size();
@@ -2803,29 +3657,7 @@ bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBl
 
     if (pindexNew->pprev == NULL || pindexNew->pprev->nChainTx) {
         // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
-        std::deque<CBlockIndex*> queue;
-        queue.push_back(pindexNew);
-
-        // Recursively process any descendant blocks that now may be eligible to be connected.
-        while (!queue.empty()) {
-            CBlockIndex *pindex = queue.front();
-            queue.pop_front();
-            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
-            {
-                LOCK(cs_nBlockSequenceId);
-                pindex->nSequenceId = nBlockSequenceId++;
-            }
-            if (chainActive.Tip() == NULL || !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
-                setBlockIndexCandidates.insert(pindex);
-            }
-            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
-            while (range.first != range.second) {
-                std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
-                queue.push_back(it->second);
-                range.first++;
-                mapBlocksUnlinked.erase(it);
-            }
-        }
+        LinkBlockTransactions(pindexNew);
     } else {
         if (pindexNew->pprev && pindexNew->pprev->IsValid(BLOCK_VALID_TREE)) {
             mapBlocksUnlinked.insert(std::make_pair(pindexNew->pprev, pindexNew));
@@ -2929,7 +3761,7 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     // We don't have block height as this is called without context (i.e. without
     // knowing the previous block), but that's okay, as the checks done are permissive
     // (i.e. doesn't check work limit or whether AuxPoW is enabled)
-    if (fCheckPOW && !CheckAuxPowProofOfWork(block, Params().GetConsensus(0)))
+    if (fCheckPOW && !CheckAuxPowProofOfWorkCached(block, Params().GetConsensus(0)))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
@@ -3201,7 +4033,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const CB
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3220,7 +4052,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, state, fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3268,11 +4100,43 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Check the proof of work of every header we do not know yet before
+    // taking cs_main for the contextual checks. These checks are
+    // context-free, so groups of headers are spread over the header check
+    // threads; headers that fail are checked again below to report why.
+    std::vector<const CBlockHeader*> vUnknown;
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
+            if (mapBlockIndex.count(header.GetHash()) == 0)
+                vUnknown.push_back(&header);
+        }
+    }
+    std::unique_ptr<bool[]> fPoWValid(new bool[headers.size()]());
+    std::vector<CHeaderPoWCheck> vChecks;
+    const size_t nGroupSize = scrypt_batch_lanes();
+    for (size_t i = 0; i < vUnknown.size(); i += nGroupSize) {
+        std::vector<const CBlockHeader*> vGroup(vUnknown.begin() + i, vUnknown.begin() + std::min(i + nGroupSize, vUnknown.size()));
+        std::vector<bool*> vfValid;
+        for (const CBlockHeader* pheader : vGroup)
+            vfValid.push_back(&fPoWValid[pheader - headers.data()]);
+        vChecks.emplace_back(vGroup, vfValid);
+    }
+    if (nScriptCheckThreads) {
+        CCheckQueueControl<CHeaderPoWCheck> control(&headercheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for (CHeaderPoWCheck& check : vChecks)
+            check();
+    }
+
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = NULL; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, !fPoWValid[i])) {
                 return false;
             }
             if (ppindex) {
@@ -3638,7 +4502,15 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    bool fLoadedFlat = false;
+    uint64_t nStamp;
+    if (fFlatBlockIndex && pblocktree->ReadFlatIndexStamp(nStamp)) {
+        int64_t nStart = GetTimeMillis();
+        fLoadedFlat = LoadBlockIndexFile(GetBlockIndexFilePath(), nStamp, mapBlockIndex, blockindexarena);
+        if (fLoadedFlat)
+            LogPrintf("%s: loaded %u block index entries from %s in %dms\n", __func__, mapBlockIndex.size(), GetBlockIndexFilePath().string(), GetTimeMillis() - nStart);
+    }
+    if (!fLoadedFlat && !pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
         return false;
 
     boost::this_thread::interruption_point();
@@ -3726,6 +4598,16 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Check whether the chainstate came from a UTXO snapshot, and whether
+    // loading it completed
+    pblocktree->ReadFlag("snapshotchain", fHaveSnapshot);
+    if (fHaveSnapshot)
+        LogPrintf("LoadBlockIndexDB(): Chainstate was loaded from a UTXO snapshot\n");
+    bool fLoadingSnapshot = false;
+    pblocktree->ReadFlag("loadingsnapshot", fLoadingSnapshot);
+    if (fLoadingSnapshot)
+        return error("LoadBlockIndexDB(): Loading a UTXO snapshot was interrupted");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -3793,8 +4675,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruned or loaded from a snapshot, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
@@ -3962,10 +4844,31 @@ void UnloadBlockIndex()
     }
 
     BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+        if (!blockindexarena.Contains(entry.second))
+            delete entry.second;
     }
     mapBlockIndex.clear();
+    blockindexarena.Clear();
     fHavePruned = false;
+    fHaveSnapshot = false;
+    utxoSetHashTip = CUTXOSetHash();
+    fUTXOSetHashTip = false;
+    blockreadahead.Prefetch(std::vector<const CBlockIndex*>());
+}
+
+bool WriteFlatBlockIndex()
+{
+    LOCK(cs_main);
+    // Only a fully loaded index that matches the database can be stamped as
+    // its copy
+    if (chainActive.Tip() == NULL || !setDirtyBlockIndex.empty())
+        return false;
+    int64_t nStart = GetTimeMillis();
+    uint64_t nStamp = GetRand(std::numeric_limits<uint64_t>::max());
+    if (!WriteBlockIndexFile(GetBlockIndexFilePath(), mapBlockIndex, nStamp) || !pblocktree->WriteFlatIndexStamp(nStamp))
+        return error("%s: failed to write the flat block index", __func__);
+    LogPrintf("%s: wrote %u block index entries in %dms\n", __func__, mapBlockIndex.size(), GetTimeMillis() - nStart);
+    return true;
 }
 
 bool LoadBlockIndex(const CChainParams& chainparams)
@@ -4455,6 +5358,370 @@ void DumpMempool(void)
     }
 }
 
+void ApplyCoinsStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << *(const CScriptBase*)(&output.second.out.scriptPubKey);
+        ss << VARINT(output.second.out.nValue);
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+    }
+    ss << VARINT(0);
+}
+
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    stats.hashBlock = pcursor->GetBestBlock();
+    {
+        LOCK(cs_main);
+        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+    }
+    ss << stats.hashBlock;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyCoinsStats(stats, ss, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+            stats.nSerializedSize += 32 + 4 + pcursor->GetValueSize();
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    if (!outputs.empty()) {
+        ApplyCoinsStats(stats, ss, prevkey, outputs);
+    }
+    stats.hashSerialized = ss.GetHash();
+    return true;
+}
+
+bool ComputeUTXOSetHash(CCoinsView *view, CUTXOSetHash &hash)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+
+    hash = CUTXOSetHash();
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            hash.AddCoin(key, coin);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool LoadUTXOSetHash()
+{
+    LOCK(cs_main);
+    fUTXOSetHashTip = false;
+    CValidationState state;
+    if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
+        return false;
+    if (pcoinsdbview->GetUTXOSetHash(utxoSetHashTip)) {
+        LogPrintf("%s: UTXO set hash at %s: %s\n", __func__, pcoinsTip->GetBestBlock().ToString(), utxoSetHashTip.GetHash().ToString());
+    } else {
+        // Older databases, and ones not shut down cleanly since, have no
+        // hash for their best block: start over from the whole UTXO set.
+        LogPrintf("%s: computing the UTXO set hash...\n", __func__);
+        int64_t nStart = GetTimeMillis();
+        if (!ComputeUTXOSetHash(pcoinsdbview, utxoSetHashTip))
+            return false;
+        LogPrintf("%s: UTXO set hash at %s: %s (%dms)\n", __func__, pcoinsTip->GetBestBlock().ToString(), utxoSetHashTip.GetHash().ToString(), GetTimeMillis() - nStart);
+    }
+    fUTXOSetHashTip = true;
+    return true;
+}
+
+bool GetUTXOSetHash(CUTXOSetHash &hash)
+{
+    AssertLockHeld(cs_main);
+    if (!fUTXOSetHashTip)
+        return false;
+    hash = utxoSetHashTip;
+    return true;
+}
+
+static const uint64_t UTXO_SNAPSHOT_VERSION = 1;
+
+//! Memory to fill with coins before each coin database write while loading a snapshot.
+static const size_t UTXO_SNAPSHOT_BATCH_SIZE = 1 << 25;
+
+static void WriteSnapshotOutputs(CAutoFile& fileout, CHashWriter& ss, CCoinsStats& stats, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    fileout << hash;
+    WriteCompactSize(fileout, outputs.size());
+    for (const auto& output : outputs) {
+        fileout << VARINT(output.first);
+        fileout << output.second;
+    }
+    ApplyCoinsStats(stats, ss, hash, outputs);
+}
+
+bool DumpUTXOSnapshot(const fs::path& path, CUTXOSnapshotMetadata& metadata, CCoinsStats& stats)
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        // The cursor iterates over a consistent view of the database, so
+        // the chain can move on while the snapshot is written.
+        pcursor.reset(pcoinsdbview->Cursor());
+        const CBlockIndex* pindex = mapBlockIndex.find(pcursor->GetBestBlock())->second;
+        metadata.hashBlock = pindex->GetBlockHash();
+        metadata.nChainTx = pindex->nChainTx;
+        metadata.nCoins = 0;
+        stats = CCoinsStats();
+        stats.nHeight = pindex->nHeight;
+        stats.hashBlock = metadata.hashBlock;
+    }
+
+    fs::path pathTmp = path.string() + ".incomplete";
+    try {
+        FILE* filestr = fsbridge::fopen(pathTmp, "wb");
+        if (!filestr)
+            return error("%s: unable to open %s", __func__, pathTmp.string());
+
+        CAutoFile fileout(filestr, SER_DISK, CLIENT_VERSION);
+        fileout << UTXO_SNAPSHOT_VERSION;
+        fileout << metadata;
+
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << stats.hashBlock;
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+                return error("%s: unable to read value", __func__);
+            if (!outputs.empty() && key.hash != prevkey) {
+                WriteSnapshotOutputs(fileout, ss, stats, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+            stats.nSerializedSize += 32 + 4 + pcursor->GetValueSize();
+            pcursor->Next();
+        }
+        if (!outputs.empty()) {
+            WriteSnapshotOutputs(fileout, ss, stats, prevkey, outputs);
+        }
+        stats.hashSerialized = ss.GetHash();
+        fileout << stats.hashSerialized;
+
+        // The header has a fixed size; fill in the number of coins now that it is known.
+        metadata.nCoins = stats.nTransactionOutputs;
+        if (fseek(fileout.Get(), 0, SEEK_SET))
+            return error("%s: unable to rewind %s", __func__, pathTmp.string());
+        fileout << UTXO_SNAPSHOT_VERSION;
+        fileout << metadata;
+        FileCommit(fileout.Get());
+        fileout.fclose();
+        if (!RenameOver(pathTmp, path))
+            return error("%s: unable to rename %s", __func__, pathTmp.string());
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+
+    LogPrintf("Dumped UTXO snapshot at %s: %u outputs, %.2fs\n", metadata.hashBlock.ToString(), metadata.nCoins, (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
+/**
+ * Read a UTXO snapshot and check it against the hash it carries. If pdb is
+ * given, the coins are also written to it in batches, in the order they
+ * appear in the snapshot (which is the database's key order).
+ */
+static bool ReadUTXOSnapshot(const fs::path& path, CUTXOSnapshotMetadata& metadata, CCoinsStats& stats, CCoinsViewDB* pdb)
+{
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: unable to open %s", __func__, path.string());
+
+    try {
+        uint64_t version;
+        filein >> version;
+        if (version != UTXO_SNAPSHOT_VERSION)
+            return error("%s: unsupported snapshot version %d", __func__, version);
+        filein >> metadata;
+
+        stats = CCoinsStats();
+        stats.hashBlock = metadata.hashBlock;
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << stats.hashBlock;
+        std::map<uint32_t, Coin> outputs;
+        std::vector<std::pair<COutPoint, Coin> > vCoins;
+        size_t nBatchUsage = 0;
+        while (stats.nTransactionOutputs < metadata.nCoins) {
+            boost::this_thread::interruption_point();
+            uint256 hash;
+            filein >> hash;
+            uint64_t nOutputs = ReadCompactSize(filein);
+            if (nOutputs == 0 || nOutputs > metadata.nCoins - stats.nTransactionOutputs)
+                return error("%s: invalid number of outputs for %s", __func__, hash.ToString());
+            outputs.clear();
+            for (uint64_t i = 0; i < nOutputs; i++) {
+                uint32_t n;
+                filein >> VARINT(n);
+                filein >> outputs[n];
+            }
+            if (outputs.size() != nOutputs)
+                return error("%s: duplicate outputs for %s", __func__, hash.ToString());
+            ApplyCoinsStats(stats, ss, hash, outputs);
+
+            if (pdb) {
+                for (auto& output : outputs) {
+                    nBatchUsage += sizeof(std::pair<COutPoint, Coin>) + output.second.DynamicMemoryUsage();
+                    vCoins.emplace_back(COutPoint(hash, output.first), std::move(output.second));
+                }
+                if (nBatchUsage > UTXO_SNAPSHOT_BATCH_SIZE) {
+                    if (!pdb->WriteCoins(vCoins))
+                        return error("%s: failed to write to coin database", __func__);
+                    vCoins.clear();
+                    nBatchUsage = 0;
+                }
+            }
+        }
+        if (pdb && !pdb->WriteCoins(vCoins))
+            return error("%s: failed to write to coin database", __func__);
+
+        stats.hashSerialized = ss.GetHash();
+        uint256 hashSerialized;
+        filein >> hashSerialized;
+        if (hashSerialized != stats.hashSerialized)
+            return error("%s: %s is corrupt", __func__, path.string());
+    } catch (const std::exception& e) {
+        return error("%s: deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool LoadUTXOSnapshot(CValidationState& state, const CChainParams& chainparams, const fs::path& path, const uint256& hashExpected, CUTXOSnapshotMetadata& metadata)
+{
+    int64_t nStart = GetTimeMicros();
+
+    // Check the whole snapshot before touching the chainstate.
+    CCoinsStats stats;
+    if (!ReadUTXOSnapshot(path, metadata, stats, NULL))
+        return state.Error(strprintf("unable to read UTXO snapshot %s", path.string()));
+    if (stats.hashSerialized != hashExpected)
+        return state.Error(strprintf("UTXO snapshot hash %s does not match the expected %s", stats.hashSerialized.ToString(), hashExpected.ToString()));
+
+    CBlockIndex* pindexOldTip;
+    CBlockIndex* pindexSnapshot;
+    bool fInitialDownload;
+    {
+        LOCK(cs_main);
+        if (fTxIndex)
+            return state.Error("a UTXO snapshot cannot be loaded with -txindex");
+        if (fHaveSnapshot)
+            return state.Error("a UTXO snapshot was already loaded");
+        BlockMap::iterator mi = mapBlockIndex.find(metadata.hashBlock);
+        if (mi == mapBlockIndex.end())
+            return state.Error(strprintf("the header of snapshot block %s is not known yet", metadata.hashBlock.ToString()));
+        pindexSnapshot = mi->second;
+        pindexOldTip = chainActive.Tip();
+        if (pindexOldTip == NULL || pindexSnapshot->nHeight <= pindexOldTip->nHeight ||
+                pindexSnapshot->GetAncestor(pindexOldTip->nHeight) != pindexOldTip)
+            return state.Error(strprintf("snapshot block %s does not extend the current tip", metadata.hashBlock.ToString()));
+        if (pindexSnapshot->nStatus & BLOCK_FAILED_MASK)
+            return state.Error(strprintf("snapshot block %s is invalid", metadata.hashBlock.ToString()));
+
+        // From here on the coin database is rewritten in several batches; if
+        // that is interrupted the node refuses to start until a -reindex.
+        if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
+            return false;
+        if (!pblocktree->WriteFlag("loadingsnapshot", true))
+            return AbortNode(state, "Failed to write to block index database");
+        LogPrintf("Loading UTXO snapshot at %s (height %d, %u outputs)\n", metadata.hashBlock.ToString(), pindexSnapshot->nHeight, metadata.nCoins);
+        if (!pcoinsdbview->EraseCoins())
+            return AbortNode(state, "Failed to clear the coin database");
+        CUTXOSnapshotMetadata metadataLoaded;
+        CCoinsStats statsLoaded;
+        if (!ReadUTXOSnapshot(path, metadataLoaded, statsLoaded, pcoinsdbview) || statsLoaded.hashSerialized != stats.hashSerialized)
+            return AbortNode(state, "Failed to load the UTXO snapshot");
+        CCoinsMap mapCoinsEmpty;
+        if (!pcoinsdbview->BatchWrite(mapCoinsEmpty, metadata.hashBlock))
+            return AbortNode(state, "Failed to write to coin database");
+        pcoinsTip->SetBestBlock(metadata.hashBlock);
+        // Start the rolling UTXO set hash over from the snapshot's coins.
+        fUTXOSetHashTip = ComputeUTXOSetHash(pcoinsdbview, utxoSetHashTip);
+        if (!fUTXOSetHashTip)
+            return AbortNode(state, "Failed to read the coin database");
+
+        // Blocks between the old tip and the snapshot block that were never
+        // downloaded are treated as pruned: give them a placeholder
+        // transaction count (making the snapshot block's nChainTx match the
+        // snapshot) and link them, along with any blocks already downloaded
+        // past them, as if their data had been seen.
+        std::vector<CBlockIndex*> vLink;
+        for (CBlockIndex* pindex = pindexSnapshot; pindex->nChainTx == 0; pindex = pindex->pprev)
+            vLink.push_back(pindex);
+        std::reverse(vLink.begin(), vLink.end());
+        if (!vLink.empty()) {
+            uint64_t nChainTx = vLink.front()->pprev->nChainTx;
+            for (CBlockIndex* pindex : vLink) {
+                if (pindex->nTx == 0)
+                    pindex->nTx = (pindex == pindexSnapshot && metadata.nChainTx > nChainTx) ? metadata.nChainTx - nChainTx : 1;
+                nChainTx += pindex->nTx;
+                if (pindex != vLink.front() && !(pindex->nStatus & BLOCK_HAVE_DATA))
+                    mapBlocksUnlinked.insert(std::make_pair(pindex->pprev, pindex));
+            }
+            LinkBlockTransactions(vLink.front());
+        }
+        for (CBlockIndex* pindex = pindexSnapshot; pindex != pindexOldTip; pindex = pindex->pprev) {
+            pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            setDirtyBlockIndex.insert(pindex);
+        }
+
+        UpdateTip(pindexSnapshot, chainparams);
+        PruneBlockIndexCandidates();
+        mempool.clear();
+
+        if (!fHavePruned) {
+            pblocktree->WriteFlag("prunedblockfiles", true);
+            fHavePruned = true;
+        }
+        pblocktree->WriteFlag("snapshotchain", true);
+        fHaveSnapshot = true;
+        if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
+            return false;
+        if (!pblocktree->WriteFlag("loadingsnapshot", false))
+            return AbortNode(state, "Failed to write to block index database");
+        fInitialDownload = IsInitialBlockDownload();
+    }
+    CheckBlockIndex(chainparams.GetConsensus(pindexSnapshot->nHeight));
+
+    GetMainSignals().UpdatedBlockTip(pindexSnapshot, pindexOldTip, fInitialDownload);
+    uiInterface.NotifyBlockTip(fInitialDownload, pindexSnapshot);
+
+    LogPrintf("Loaded UTXO snapshot: %.2fs\n", (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, CBlockIndex *pindex) {
     if (pindex == NULL)
@@ -18,6 +18,7 @@
 #include "policy/policy.h" // For RECOMMENDED_MIN_TX_FEE
 #include "protocol.h" // For CMessageHeader::MessageStartChars
 #include "script/script_error.h"
+#include "script/sigcache.h"
 #include "sync.h"
 #include "versionbits.h"
 
@@ -37,11 +38,16 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
+class CCoinsViewFlusher;
+class CPoWCacheDB;
 class CBloomFilter;
 class CBlockUndo;
 class CChainParams;
 class CInv;
 class CConnman;
+class CDeferredSigChecks;
+class CHashWriter;
 class CScriptCheck;
 class CTxMemPool;
 class CValidationInterface;
@@ -91,6 +97,8 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -deferredsigchecks, verifying the signatures of a block together after its scripts */
+static const bool DEFAULT_DEFERRED_SIG_CHECKS = true;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -143,6 +151,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_POWCACHE = true;
+static const bool DEFAULT_FLATBLOCKINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -mempoolreplacement */
@@ -177,7 +187,10 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern bool fDeferSigChecks;
 extern bool fTxIndex;
+/** Whether to load the block index from, and save it to, the flat block index file */
+extern bool fFlatBlockIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -204,6 +217,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 /** Pruning-related variables and constants */
 /** True if any block files have ever been pruned. */
 extern bool fHavePruned;
+/** True if the chainstate was loaded from a UTXO snapshot, so blocks below it were never downloaded. */
+extern bool fHaveSnapshot;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
@@ -213,6 +228,8 @@ static const unsigned int MIN_BLOCKS_TO_KEEP = 1440;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -backgroundflush, writing the coins cache to disk from a separate thread */
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 
 // Require that user allocate at least 22,00MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 1,440 blocks = 1,440MB.
@@ -273,8 +290,20 @@ bool InitBlockIndex(const CChainParams& chainparams);
 bool LoadBlockIndex(const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex();
+/** Save the block index to the flat block index file, once it has been flushed to the database */
+bool WriteFlatBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof of work checking thread */
+void ThreadHeaderCheck();
+/** Run an instance of the coins prefetching thread */
+void ThreadCoinsPrefetch();
+/** Run an instance of the deferred signature verification thread */
+void ThreadSigVerify();
+/** Run an instance of the thread reading blocks ahead of connecting them */
+void ThreadBlockReadAhead();
+/** Run the thread writing flushed coins to the coins database */
+void ThreadFlushCoins();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -343,6 +372,25 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced = NULL,
                         bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/**
+ * (try to) add transaction to memory pool, checking its scripts without
+ * holding cs_main, so that transactions from several threads can be
+ * verified at once. Must be called without cs_main held.
+ */
+bool AcceptToMemoryPoolUnlocked(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
+                        bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced = NULL,
+                        bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+
+/**
+ * (try to) add a batch of transactions to memory pool, parents before
+ * children. Transactions not depending on each other are checked together,
+ * with their scripts spread over the script check threads. vState and
+ * vMissingInputs receive the outcome for each transaction, and the result
+ * tells which were accepted. Must be called without cs_main held.
+ */
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vState,
+                        std::vector<bool>& vMissingInputs, bool fLimitFree, const CAmount nAbsurdFee=0);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -380,10 +428,22 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. If pdeferred is not NULL as well, those script checks leave
+ * their signature checks to pdeferred.
+ * Valid signatures are cached if cacheSigStore is set, and, if the scripts were run inline, so is
+ * the transaction as a whole with these flags if cacheFullScriptStore is set. A transaction found
+ * in that cache is valid without running any script; unless cacheFullScriptStore is set, it is
+ * removed from the cache.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
+                 std::vector<CScriptCheck> *pvChecks = NULL, CDeferredSigChecks *pdeferred = NULL);
+
+/** Initializes the script-execution cache */
+void InitScriptExecutionCache();
+
+/** The script verification flags of a block at nHeight on top of pindexPrev */
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev, int nHeight, const CChainParams& chainparams);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -458,12 +518,13 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    CDeferredSigChecks *pdeferred;
 
 public:
-    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), pdeferred(NULL) {}
+    CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn, CDeferredSigChecks* pdeferredIn = NULL) :
+        scriptPubKey(scriptPubKeyIn), amount(amountIn),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pdeferred(pdeferredIn) { }
 
     bool operator()();
 
@@ -476,9 +537,106 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pdeferred, check.pdeferred);
     }
 
     ScriptError GetScriptError() const { return error; }
+
+    bool IsCacheStore() const { return cacheStore; }
+};
+
+/**
+ * Signature checks left over by the script checks of a block. Verify() runs
+ * them together once all scripts ran: identical checks are verified once, each
+ * public key is parsed once per group of checks, and the groups are spread
+ * over a dedicated thread pool. Script checks with an invalid signature among
+ * their deferred ones are run again inline to find their actual outcome.
+ */
+class CDeferredSigChecks
+{
+private:
+    CCriticalSection cs;
+    std::vector<std::pair<CScriptCheck, std::vector<CDeferredSigCheck> > > vScripts;
+
+public:
+    //! Take over a script check that passed with the given signatures assumed valid
+    void Add(CScriptCheck&& check, std::vector<CDeferredSigCheck>&& vSigs);
+
+    //! Verify all deferred signatures, returning whether all their scripts are valid
+    bool Verify();
+};
+
+/**
+ * Closure verifying a group of deferred signature checks which all use the
+ * same public key. operator() always succeeds; the outcome of each check is
+ * stored in the check itself.
+ */
+class CSigVerifyCheck
+{
+private:
+    std::vector<CDeferredSigCheck*> vChecks;
+
+public:
+    CSigVerifyCheck() {}
+    explicit CSigVerifyCheck(const std::vector<CDeferredSigCheck*>& vChecksIn) : vChecks(vChecksIn) {}
+
+    bool operator()();
+
+    void swap(CSigVerifyCheck &check) {
+        vChecks.swap(check.vChecks);
+    }
+};
+
+/**
+ * Closure representing the context-free proof of work check (scrypt hash and
+ * auxpow) of a group of block headers. The group is hashed through the
+ * multi-lane scrypt kernel, and the outcome for each header is written to
+ * the flag given for it. operator() always succeeds, so that one bad header
+ * does not stop the queue from checking the others.
+ */
+class CHeaderPoWCheck
+{
+private:
+    std::vector<const CBlockHeader*> vHeaders;
+    std::vector<bool*> vfValid;
+
+public:
+    CHeaderPoWCheck() {}
+    CHeaderPoWCheck(const std::vector<const CBlockHeader*>& vHeadersIn, const std::vector<bool*>& vfValidIn) :
+        vHeaders(vHeadersIn), vfValid(vfValidIn) { }
+
+    bool operator()();
+
+    void swap(CHeaderPoWCheck &check) {
+        vHeaders.swap(check.vHeaders);
+        vfValid.swap(check.vfValid);
+    }
+};
+
+/**
+ * Closure looking up a group of outpoints in a coins view that allows
+ * concurrent reads, storing each coin next to its outpoint. Coins that
+ * are not found are left spent.
+ */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsView *pview;
+    std::pair<COutPoint, Coin> *pbegin;
+    std::pair<COutPoint, Coin> *pend;
+
+public:
+    CCoinsPrefetchCheck() : pview(NULL), pbegin(NULL), pend(NULL) {}
+    CCoinsPrefetchCheck(const CCoinsView *pviewIn, std::pair<COutPoint, Coin> *pbeginIn, std::pair<COutPoint, Coin> *pendIn) :
+        pview(pviewIn), pbegin(pbeginIn), pend(pendIn) { }
+
+    bool operator()();
+
+    void swap(CCoinsPrefetchCheck &check) {
+        std::swap(pview, check.pview);
+        std::swap(pbegin, check.pbegin);
+        std::swap(pend, check.pend);
+    }
 };
 
 
@@ -487,6 +645,9 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+/** Read the serialized block at pos without deserializing it, e.g. to relay it as-is */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
@@ -504,15 +665,16 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const CB
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
+ *  can fail if those validity checks fail (among other reasons).
+ *  If pUTXOSetHash is given, the created and spent coins are applied to it once the block is connected. */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins,
-                  const CChainParams& chainparams, bool fJustCheck = false);
+                  const CChainParams& chainparams, bool fJustCheck = false, CUTXOSetHash* pUTXOSetHash = NULL);
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified, and so may pUTXOSetHash. */
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, CUTXOSetHash* pUTXOSetHash = NULL);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
@@ -552,12 +714,21 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/** Global variable that points to the coins database (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
+/** Global variable that points to the layer writing flushed coins to pcoinsdbview in the background */
+extern CCoinsViewFlusher *pcoinsflusher;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Cache of scrypt hashes of headers whose proof of work was checked (NULL if -powcache=0) */
+extern CPoWCacheDB *ppowcache;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -593,4 +764,65 @@ void DumpMempool();
 /** Load the mempool from disk. */
 bool LoadMempool();
 
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    uint256 hashSerialized;
+    arith_uint256 nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+};
+
+/** Add the unspent outputs of one transaction to the statistics and the UTXO set hash. */
+void ApplyCoinsStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs);
+
+/** Calculate statistics about the unspent transaction output set */
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats);
+
+/** Calculate the rolling hash of the unspent transaction output set from scratch */
+bool ComputeUTXOSetHash(CCoinsView *view, CUTXOSetHash &hash);
+
+/** Load the rolling UTXO set hash of the chain tip from the coin database, or compute it if it was not stored */
+bool LoadUTXOSetHash();
+
+/** Get the rolling UTXO set hash of the chain tip, kept up to date as blocks are connected and disconnected */
+bool GetUTXOSetHash(CUTXOSetHash &hash);
+
+/** Header of a UTXO snapshot file, as written by DumpUTXOSnapshot. */
+struct CUTXOSnapshotMetadata
+{
+    //! The block whose UTXO set the snapshot holds
+    uint256 hashBlock;
+    //! Number of transactions in the chain up to and including that block
+    uint64_t nChainTx;
+    //! Number of unspent outputs in the snapshot
+    uint64_t nCoins;
+
+    CUTXOSnapshotMetadata() : nChainTx(0), nCoins(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(nChainTx);
+        READWRITE(nCoins);
+    }
+};
+
+/** Write the UTXO set of the chain tip to a snapshot file. */
+bool DumpUTXOSnapshot(const fs::path& path, CUTXOSnapshotMetadata& metadata, CCoinsStats& stats);
+
+/**
+ * Replace the UTXO set with a snapshot written by DumpUTXOSnapshot and make
+ * the snapshot's block the chain tip. The snapshot must hash to hashExpected
+ * (its hash_serialized_2 from gettxoutsetinfo), and its block must be a known
+ * descendant of the current tip. Blocks in between are treated as pruned.
+ */
+bool LoadUTXOSnapshot(CValidationState& state, const CChainParams& chainparams, const fs::path& path, const uint256& hashExpected, CUTXOSnapshotMetadata& metadata);
+
 #endif // BITCOIN_VALIDATION_H
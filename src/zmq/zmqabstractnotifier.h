@@ -7,6 +7,7 @@
 
 #include "zmqconfig.h"
 
+class CBlock;
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
@@ -34,6 +35,7 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyBlockTemplate(const CBlock &block);
 
 protected:
     void *psocket;
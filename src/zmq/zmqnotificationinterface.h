@@ -6,9 +6,12 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include "validationinterface.h"
-#include <string>
+#include <list>
 #include <map>
+#include <memory>
+#include <string>
 
+class CBlock;
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
@@ -26,6 +29,7 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock);
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+    void NewBlockTemplate(const std::shared_ptr<const CBlock>& block);
 
 private:
     CZMQNotificationInterface();
@@ -16,6 +16,8 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_HASHTEMPLATE = "hashtemplate";
+static const char *MSG_RAWTEMPLATE  = "rawtemplate";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -195,3 +197,21 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishHashTemplateNotifier::NotifyBlockTemplate(const CBlock &block)
+{
+    uint256 hash = block.GetHash();
+    LogPrint("zmq", "zmq: Publish hashtemplate %s\n", hash.GetHex());
+    char data[32];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    return SendMessage(MSG_HASHTEMPLATE, data, 32);
+}
+
+bool CZMQPublishRawTemplateNotifier::NotifyBlockTemplate(const CBlock &block)
+{
+    LogPrint("zmq", "zmq: Publish rawtemplate %s\n", block.GetHash().GetHex());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    ss << block;
+    return SendMessage(MSG_RAWTEMPLATE, &(*ss.begin()), ss.size());
+}
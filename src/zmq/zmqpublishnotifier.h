@@ -52,4 +52,16 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+class CZMQPublishHashTemplateNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockTemplate(const CBlock &block);
+};
+
+class CZMQPublishRawTemplateNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockTemplate(const CBlock &block);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H